@@ -0,0 +1,323 @@
+// bench-common.c: Shared benchmark fixture
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "bench-common.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+
+#define NAME_OWNER_TIMEOUT_USEC (10 * G_USEC_PER_SEC)
+
+/* Stands in for Steam's URI handler, used by AppChooser and Email */
+static const char steam_helper_desktop[] =
+  "[Desktop Entry]\n"
+  "Type=Application\n"
+  "Name=Steam\n"
+  "Exec=true %u\n"
+  "NoDisplay=true\n"
+  "MimeType=x-scheme-handler/steam;x-scheme-handler/mailto;\n";
+
+/* Benchmarks call the process-starting methods far more often than the
+ * default limits allow */
+static const char ratelimit_conf[] =
+  "[Application]\n"
+  "Burst=0\n";
+
+static void
+rm_rf (const char *path)
+{
+  g_autoptr (GDir) dir = g_dir_open (path, 0, NULL);
+
+  if (dir != NULL)
+    {
+      const char *name;
+
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          g_autofree char *child = g_build_filename (path, name, NULL);
+
+          if (g_file_test (child, G_FILE_TEST_IS_DIR) && !g_file_test (child, G_FILE_TEST_IS_SYMLINK))
+            rm_rf (child);
+          else
+            g_unlink (child);
+        }
+    }
+
+  g_rmdir (path);
+}
+
+static bool
+write_file (const char *dir,
+            const char *basename,
+            const char *contents,
+            GError **error)
+{
+  g_autofree char *path = g_build_filename (dir, basename, NULL);
+
+  if (g_mkdir_with_parents (dir, 0755) != 0)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                   "Unable to create %s: %s", dir, g_strerror (saved_errno));
+      return false;
+    }
+
+  return g_file_set_contents (path, contents, -1, error);
+}
+
+static bool
+wait_for_name_owner (GDBusConnection *connection,
+                     GSubprocess *daemon,
+                     GError **error)
+{
+  gint64 deadline = g_get_monotonic_time () + NAME_OWNER_TIMEOUT_USEC;
+
+  while (g_get_monotonic_time () < deadline)
+    {
+      g_autoptr (GVariant) reply =
+        g_dbus_connection_call_sync (connection,
+                                     "org.freedesktop.DBus",
+                                     "/org/freedesktop/DBus",
+                                     "org.freedesktop.DBus",
+                                     "NameHasOwner",
+                                     g_variant_new ("(s)", BENCH_PORTAL_NAME),
+                                     G_VARIANT_TYPE ("(b)"),
+                                     G_DBUS_CALL_FLAGS_NONE,
+                                     -1,
+                                     NULL,
+                                     error);
+      gboolean has_owner = FALSE;
+
+      if (reply == NULL)
+        return false;
+
+      g_variant_get (reply, "(b)", &has_owner);
+      if (has_owner)
+        return true;
+
+      /* The identifier is cleared once the process has been reaped */
+      if (g_subprocess_get_identifier (daemon) == NULL)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "The portal exited early");
+          return false;
+        }
+
+      g_usleep (10 * 1000);
+    }
+
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+               "Timed out waiting for %s", BENCH_PORTAL_NAME);
+  return false;
+}
+
+BenchFixture *
+bench_fixture_new (const char *daemon_path,
+                   const char * const *daemon_args,
+                   const char *settings_conf,
+                   const char *lockdown_conf,
+                   GError **error)
+{
+  g_autoptr (BenchFixture) fixture = g_new0 (BenchFixture, 1);
+
+  fixture->tmpdir = g_dir_make_tmp ("xdg-desktop-portal-holo-bench-XXXXXX", error);
+  if (fixture->tmpdir == NULL)
+    return NULL;
+
+  g_autofree char *config_home = g_build_filename (fixture->tmpdir, "config", NULL);
+  g_autofree char *config_dirs = g_build_filename (fixture->tmpdir, "etc", NULL);
+  g_autofree char *data_home = g_build_filename (fixture->tmpdir, "data", NULL);
+  g_autofree char *data_dirs = g_build_filename (fixture->tmpdir, "share", NULL);
+  g_autofree char *cache_home = g_build_filename (fixture->tmpdir, "cache", NULL);
+  g_autofree char *applications_dir = g_build_filename (data_dirs, "applications", NULL);
+
+  fixture->config_dir = g_build_filename (config_home, "SteamOS", "portal", NULL);
+
+  if (!write_file (applications_dir, "steam_http_loader.desktop", steam_helper_desktop, error))
+    return NULL;
+
+  if (!write_file (fixture->config_dir, "ratelimit.conf", ratelimit_conf, error))
+    return NULL;
+
+  if (settings_conf != NULL && !write_file (fixture->config_dir, "settings.conf", settings_conf, error))
+    return NULL;
+
+  if (lockdown_conf != NULL && !write_file (fixture->config_dir, "lockdown.conf", lockdown_conf, error))
+    return NULL;
+
+  /* Sets DBUS_SESSION_BUS_ADDRESS for the portal to inherit */
+  fixture->bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  g_test_dbus_up (fixture->bus);
+
+  g_autoptr (GSubprocessLauncher) launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_NONE);
+  g_subprocess_launcher_setenv (launcher, "XDG_CONFIG_HOME", config_home, TRUE);
+  g_subprocess_launcher_setenv (launcher, "XDG_CONFIG_DIRS", config_dirs, TRUE);
+  g_subprocess_launcher_setenv (launcher, "XDG_DATA_HOME", data_home, TRUE);
+  g_subprocess_launcher_setenv (launcher, "XDG_DATA_DIRS", data_dirs, TRUE);
+  g_subprocess_launcher_setenv (launcher, "XDG_CACHE_HOME", cache_home, TRUE);
+  g_subprocess_launcher_setenv (launcher, "GIO_USE_VFS", "local", TRUE);
+
+  g_autoptr (GPtrArray) argv = g_ptr_array_new ();
+  g_ptr_array_add (argv, (gpointer) daemon_path);
+  for (size_t i = 0; daemon_args != NULL && daemon_args[i] != NULL; i++)
+    g_ptr_array_add (argv, (gpointer) daemon_args[i]);
+  g_ptr_array_add (argv, NULL);
+
+  fixture->daemon = g_subprocess_launcher_spawnv (launcher, (const char * const *) argv->pdata, error);
+  if (fixture->daemon == NULL)
+    return NULL;
+
+  fixture->connection = bench_fixture_connect (fixture, error);
+  if (fixture->connection == NULL)
+    return NULL;
+
+  if (!wait_for_name_owner (fixture->connection, fixture->daemon, error))
+    return NULL;
+
+  return g_steal_pointer (&fixture);
+}
+
+void
+bench_fixture_free (BenchFixture *fixture)
+{
+  if (fixture == NULL)
+    return;
+
+  if (fixture->connection != NULL)
+    g_dbus_connection_close_sync (fixture->connection, NULL, NULL);
+  g_clear_object (&fixture->connection);
+
+  if (fixture->daemon != NULL)
+    {
+      g_subprocess_send_signal (fixture->daemon, SIGTERM);
+      g_subprocess_wait (fixture->daemon, NULL, NULL);
+      g_clear_object (&fixture->daemon);
+    }
+
+  if (fixture->bus != NULL)
+    {
+      g_test_dbus_down (fixture->bus);
+      g_clear_object (&fixture->bus);
+    }
+
+  if (fixture->tmpdir != NULL)
+    rm_rf (fixture->tmpdir);
+
+  g_free (fixture->tmpdir);
+  g_free (fixture->config_dir);
+  g_free (fixture);
+}
+
+GDBusConnection *
+bench_fixture_connect (BenchFixture *fixture,
+                       GError **error)
+{
+  return g_dbus_connection_new_for_address_sync (g_test_dbus_get_bus_address (fixture->bus),
+                                                 G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                 G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                 NULL,
+                                                 NULL,
+                                                 error);
+}
+
+char *
+bench_fixture_get_config_path (BenchFixture *fixture,
+                               const char *basename)
+{
+  return g_build_filename (fixture->config_dir, basename, NULL);
+}
+
+bool
+bench_fixture_write_config (BenchFixture *fixture,
+                            const char *basename,
+                            const char *contents,
+                            bool atomic,
+                            GError **error)
+{
+  if (atomic)
+    return write_file (fixture->config_dir, basename, contents, error);
+
+  g_autofree char *path = bench_fixture_get_config_path (fixture, basename);
+  FILE *f = fopen (path, "w");
+
+  if (f == NULL)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                   "Unable to open %s: %s", path, g_strerror (saved_errno));
+      return false;
+    }
+
+  fputs (contents, f);
+
+  if (fclose (f) != 0)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                   "Unable to write %s: %s", path, g_strerror (saved_errno));
+      return false;
+    }
+
+  return true;
+}
+
+static int
+compare_samples (gconstpointer a,
+                 gconstpointer b)
+{
+  gint64 sample_a = *(const gint64 *) a;
+  gint64 sample_b = *(const gint64 *) b;
+
+  return (sample_a > sample_b) - (sample_a < sample_b);
+}
+
+/* Nearest-rank percentile of the sorted @samples */
+static gint64
+percentile (GArray *samples,
+            double p)
+{
+  size_t rank = (size_t) ceil (p * samples->len);
+
+  if (rank > 0)
+    rank--;
+
+  return g_array_index (samples, gint64, MIN (rank, samples->len - 1));
+}
+
+void
+bench_json_append_latencies (GString *json,
+                             GArray *samples)
+{
+  if (samples->len == 0)
+    {
+      g_string_append (json, "null");
+      return;
+    }
+
+  g_array_sort (samples, compare_samples);
+
+  double sum = 0;
+  for (guint i = 0; i < samples->len; i++)
+    sum += g_array_index (samples, gint64, i);
+
+  g_string_append_printf (json,
+                          "{ \"min\": %" G_GINT64_FORMAT
+                          ", \"mean\": %.1f"
+                          ", \"p50\": %" G_GINT64_FORMAT
+                          ", \"p99\": %" G_GINT64_FORMAT
+                          ", \"p999\": %" G_GINT64_FORMAT
+                          ", \"max\": %" G_GINT64_FORMAT " }",
+                          g_array_index (samples, gint64, 0),
+                          sum / samples->len,
+                          percentile (samples, 0.50),
+                          percentile (samples, 0.99),
+                          percentile (samples, 0.999),
+                          g_array_index (samples, gint64, samples->len - 1));
+}
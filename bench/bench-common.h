@@ -0,0 +1,74 @@
+// bench-common.h: Shared benchmark fixture
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#pragma once
+
+#include <gio/gio.h>
+#include <stdbool.h>
+
+G_BEGIN_DECLS
+
+#define BENCH_PORTAL_NAME "org.freedesktop.impl.portal.desktop.holo"
+#define BENCH_PORTAL_PATH "/org/freedesktop/portal/desktop"
+
+/* A private session bus, a set of temporary XDG directories, and an
+ * instance of the portal running against both */
+typedef struct
+{
+  GTestDBus *bus;
+
+  /* Root of the temporary directories */
+  char *tmpdir;
+
+  /* $XDG_CONFIG_HOME/SteamOS/portal */
+  char *config_dir;
+
+  GSubprocess *daemon;
+
+  /* Shared connection to the private bus */
+  GDBusConnection *connection;
+} BenchFixture;
+
+/* Starts the private bus and the portal at @daemon_path, passing it
+ * @daemon_args, and waits until the portal owns its name; @settings_conf
+ * and @lockdown_conf, if not NULL, are installed beforehand */
+BenchFixture *
+bench_fixture_new (const char *daemon_path,
+                   const char * const *daemon_args,
+                   const char *settings_conf,
+                   const char *lockdown_conf,
+                   GError **error);
+
+void
+bench_fixture_free (BenchFixture *fixture);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (BenchFixture, bench_fixture_free)
+
+/* Opens a new connection to the private bus */
+GDBusConnection *
+bench_fixture_connect (BenchFixture *fixture,
+                       GError **error);
+
+/* Returns the path of @basename in the portal's configuration directory */
+char *
+bench_fixture_get_config_path (BenchFixture *fixture,
+                               const char *basename);
+
+/* Replaces @basename in the portal's configuration directory, either
+ * atomically, through a rename, or by rewriting it in place */
+bool
+bench_fixture_write_config (BenchFixture *fixture,
+                            const char *basename,
+                            const char *contents,
+                            bool atomic,
+                            GError **error);
+
+/* Appends a JSON object describing the distribution of @samples, in
+ * microseconds; @samples gets sorted */
+void
+bench_json_append_latencies (GString *json,
+                             GArray *samples);
+
+G_END_DECLS
@@ -0,0 +1,397 @@
+// portal-bench.c: Throughput and latency of the portal interfaces
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "bench-common.h"
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static char *opt_daemon;
+static int opt_clients = 8;
+static int opt_requests = 1000;
+static char **opt_methods;
+static char *opt_output;
+
+static GOptionEntry opt_entries[] = {
+  {
+    .long_name = "daemon",
+    .short_name = 0,
+    .flags = 0,
+    .arg = G_OPTION_ARG_FILENAME,
+    .arg_data = &opt_daemon,
+    .description = "Path to the xdg-desktop-portal-holo executable",
+    .arg_description = "PATH",
+  },
+  {
+    .long_name = "clients",
+    .short_name = 'c',
+    .flags = 0,
+    .arg = G_OPTION_ARG_INT,
+    .arg_data = &opt_clients,
+    .description = "Number of concurrent client connections",
+    .arg_description = "N",
+  },
+  {
+    .long_name = "requests",
+    .short_name = 'n',
+    .flags = 0,
+    .arg = G_OPTION_ARG_INT,
+    .arg_data = &opt_requests,
+    .description = "Number of calls made by each client, for each method",
+    .arg_description = "N",
+  },
+  {
+    .long_name = "method",
+    .short_name = 'm',
+    .flags = 0,
+    .arg = G_OPTION_ARG_STRING_ARRAY,
+    .arg_data = &opt_methods,
+    .description = "Only benchmark this method; can be repeated",
+    .arg_description = "NAME",
+  },
+  {
+    .long_name = "output",
+    .short_name = 'o',
+    .flags = 0,
+    .arg = G_OPTION_ARG_FILENAME,
+    .arg_data = &opt_output,
+    .description = "Write the JSON report to FILE instead of standard output",
+    .arg_description = "FILE",
+  },
+  G_OPTION_ENTRY_NULL,
+};
+
+static const char settings_conf[] =
+  "[org.freedesktop.appearance]\n"
+  "color-scheme=1\n"
+  "contrast=0\n"
+  "accent-color=0.2;0.4;0.8\n";
+
+/* The portal exposes the Printing key as the disable-printing property,
+ * and so on */
+static const char lockdown_conf[] =
+  "[Lockdown]\n"
+  "Printing=true\n"
+  "SaveToDisk=false\n"
+  "[Privacy]\n"
+  "Camera=true\n";
+
+typedef struct
+{
+  const char *name;
+  const char *interface;
+  const char *method;
+  const char *reply_type;
+
+  /* Returns a floating reference to the parameters of call @n by
+   * client @client */
+  GVariant *(* build_args) (guint client,
+                            guint n);
+} BenchMethod;
+
+static GVariant *
+build_settings_read (guint client,
+                     guint n)
+{
+  return g_variant_new ("(ss)", "org.freedesktop.appearance", "color-scheme");
+}
+
+static GVariant *
+build_settings_read_all (guint client,
+                         guint n)
+{
+  const char *namespaces[] = { "org.freedesktop.*", NULL };
+
+  return g_variant_new ("(^as)", namespaces);
+}
+
+static GVariant *
+build_lockdown_get (guint client,
+                    guint n)
+{
+  return g_variant_new ("(ss)", "org.freedesktop.impl.portal.Lockdown", "disable-printing");
+}
+
+static GVariant *
+build_lockdown_get_all (guint client,
+                        guint n)
+{
+  return g_variant_new ("(s)", "org.freedesktop.impl.portal.Lockdown");
+}
+
+static char *
+build_handle (guint client,
+              guint n)
+{
+  return g_strdup_printf (BENCH_PORTAL_PATH "/request/bench/c%u_%u", client, n);
+}
+
+static GVariant *
+build_choose_application (guint client,
+                          guint n)
+{
+  g_autofree char *handle = build_handle (client, n);
+  const char *choices[] = { "steam_http_loader", NULL };
+
+  return g_variant_new ("(oss^as@a{sv})",
+                        handle,
+                        "org.example.Bench",
+                        "",
+                        choices,
+                        g_variant_new_array (G_VARIANT_TYPE ("{sv}"), NULL, 0));
+}
+
+static GVariant *
+build_compose_email (guint client,
+                     guint n)
+{
+  g_autofree char *handle = build_handle (client, n);
+  GVariantBuilder options;
+
+  g_variant_builder_init (&options, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&options, "{sv}", "address", g_variant_new_string ("bench@example.com"));
+
+  return g_variant_new ("(oss@a{sv})",
+                        handle,
+                        "org.example.Bench",
+                        "",
+                        g_variant_builder_end (&options));
+}
+
+static const BenchMethod methods[] = {
+  {
+    .name = "Settings.Read",
+    .interface = "org.freedesktop.impl.portal.Settings",
+    .method = "Read",
+    .reply_type = "(v)",
+    .build_args = build_settings_read,
+  },
+  {
+    .name = "Settings.ReadAll",
+    .interface = "org.freedesktop.impl.portal.Settings",
+    .method = "ReadAll",
+    .reply_type = "(a{sa{sv}})",
+    .build_args = build_settings_read_all,
+  },
+  {
+    .name = "Lockdown.Get",
+    .interface = "org.freedesktop.DBus.Properties",
+    .method = "Get",
+    .reply_type = "(v)",
+    .build_args = build_lockdown_get,
+  },
+  {
+    .name = "Lockdown.GetAll",
+    .interface = "org.freedesktop.DBus.Properties",
+    .method = "GetAll",
+    .reply_type = "(a{sv})",
+    .build_args = build_lockdown_get_all,
+  },
+  {
+    .name = "AppChooser.ChooseApplication",
+    .interface = "org.freedesktop.impl.portal.AppChooser",
+    .method = "ChooseApplication",
+    .reply_type = "(ua{sv})",
+    .build_args = build_choose_application,
+  },
+  {
+    .name = "Email.ComposeEmail",
+    .interface = "org.freedesktop.impl.portal.Email",
+    .method = "ComposeEmail",
+    .reply_type = "(ua{sv})",
+    .build_args = build_compose_email,
+  },
+};
+
+typedef struct
+{
+  const BenchMethod *method;
+  GDBusConnection *connection;
+  guint index;
+
+  /* Array<gint64>, in microseconds */
+  GArray *samples;
+  guint n_errors;
+} BenchClient;
+
+static gpointer
+bench_client_run (gpointer data)
+{
+  BenchClient *client = data;
+
+  for (int n = 0; n < opt_requests; n++)
+    {
+      g_autoptr (GError) error = NULL;
+      gint64 start = g_get_monotonic_time ();
+
+      g_autoptr (GVariant) reply =
+        g_dbus_connection_call_sync (client->connection,
+                                     BENCH_PORTAL_NAME,
+                                     BENCH_PORTAL_PATH,
+                                     client->method->interface,
+                                     client->method->method,
+                                     client->method->build_args (client->index, n),
+                                     G_VARIANT_TYPE (client->method->reply_type),
+                                     G_DBUS_CALL_FLAGS_NONE,
+                                     -1,
+                                     NULL,
+                                     &error);
+      gint64 latency = g_get_monotonic_time () - start;
+
+      if (reply == NULL)
+        {
+          /* Only report the first failure, they tend to repeat */
+          if (client->n_errors++ == 0)
+            g_printerr ("%s: %s\n", client->method->name, error->message);
+          continue;
+        }
+
+      g_array_append_val (client->samples, latency);
+    }
+
+  return NULL;
+}
+
+static bool
+method_is_selected (const BenchMethod *method)
+{
+  return opt_methods == NULL || g_strv_contains ((const char * const *) opt_methods, method->name);
+}
+
+static void
+bench_method (const BenchMethod *method,
+              GDBusConnection **connections,
+              GString *json)
+{
+  g_autofree BenchClient *clients = g_new0 (BenchClient, opt_clients);
+  g_autofree GThread **threads = g_new0 (GThread *, opt_clients);
+  g_autoptr (GArray) samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+  guint n_errors = 0;
+
+  gint64 start = g_get_monotonic_time ();
+
+  for (int i = 0; i < opt_clients; i++)
+    {
+      clients[i].method = method;
+      clients[i].connection = connections[i];
+      clients[i].index = i;
+      clients[i].samples = g_array_sized_new (FALSE, FALSE, sizeof (gint64), opt_requests);
+
+      threads[i] = g_thread_new (method->name, bench_client_run, &clients[i]);
+    }
+
+  for (int i = 0; i < opt_clients; i++)
+    {
+      g_thread_join (threads[i]);
+
+      g_array_append_vals (samples, clients[i].samples->data, clients[i].samples->len);
+      n_errors += clients[i].n_errors;
+      g_array_unref (clients[i].samples);
+    }
+
+  double duration = (double) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+  g_string_append_printf (json,
+                          "    { \"name\": \"%s\", \"requests\": %u, \"errors\": %u"
+                          ", \"duration_s\": %.3f, \"throughput_rps\": %.1f, \"latency_us\": ",
+                          method->name,
+                          samples->len,
+                          n_errors,
+                          duration,
+                          samples->len / duration);
+  bench_json_append_latencies (json, samples);
+  g_string_append (json, " }");
+}
+
+int
+main (int argc,
+      char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  g_autoptr (GError) error = NULL;
+
+  g_autoptr (GOptionContext) opt_context = g_option_context_new (" - Benchmark the Holo portal");
+  g_option_context_set_summary (opt_context,
+                                "Starts the portal on a private bus, calls each of its methods\n"
+                                "from concurrent connections, and reports throughput and latency\n"
+                                "as JSON.");
+  g_option_context_add_main_entries (opt_context, opt_entries, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &error))
+    {
+      g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (opt_daemon == NULL || opt_clients < 1 || opt_requests < 1)
+    {
+      g_printerr ("%s: --daemon is required, and --clients and --requests must be positive\n",
+                  g_get_prgname ());
+      return EXIT_FAILURE;
+    }
+
+  g_autoptr (BenchFixture) fixture = bench_fixture_new (opt_daemon, NULL, settings_conf, lockdown_conf, &error);
+  if (fixture == NULL)
+    {
+      g_printerr ("Unable to start the portal: %s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  g_autofree GDBusConnection **connections = g_new0 (GDBusConnection *, opt_clients);
+  for (int i = 0; i < opt_clients; i++)
+    {
+      connections[i] = bench_fixture_connect (fixture, &error);
+      if (connections[i] == NULL)
+        {
+          g_printerr ("Unable to connect to the bus: %s\n", error->message);
+          return EXIT_FAILURE;
+        }
+    }
+
+  g_autoptr (GString) json = g_string_new (NULL);
+  bool first = true;
+
+  g_string_append_printf (json,
+                          "{\n  \"benchmark\": \"portal\",\n  \"clients\": %d,\n"
+                          "  \"requests_per_client\": %d,\n  \"results\": [\n",
+                          opt_clients,
+                          opt_requests);
+
+  for (size_t i = 0; i < G_N_ELEMENTS (methods); i++)
+    {
+      if (!method_is_selected (&methods[i]))
+        continue;
+
+      if (!first)
+        g_string_append (json, ",\n");
+      first = false;
+
+      bench_method (&methods[i], connections, json);
+    }
+
+  g_string_append (json, "\n  ]\n}\n");
+
+  for (int i = 0; i < opt_clients; i++)
+    {
+      g_dbus_connection_close_sync (connections[i], NULL, NULL);
+      g_object_unref (connections[i]);
+    }
+
+  if (opt_output != NULL)
+    {
+      if (!g_file_set_contents (opt_output, json->str, json->len, &error))
+        {
+          g_printerr ("Unable to write %s: %s\n", opt_output, error->message);
+          return EXIT_FAILURE;
+        }
+    }
+  else
+    {
+      fputs (json->str, stdout);
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,475 @@
+// reload-bench.c: Configuration reload latency and resource drift
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "bench-common.h"
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIGNAL_TIMEOUT_USEC (5 * G_USEC_PER_SEC)
+
+static char *opt_daemon;
+static int opt_iterations = 2000;
+static double opt_rate = 20.0;
+static gboolean opt_in_place;
+static char *opt_files;
+static int opt_reload_delay = -1;
+static int opt_sample_every = 50;
+static char *opt_output;
+
+static GOptionEntry opt_entries[] = {
+  {
+    .long_name = "daemon",
+    .short_name = 0,
+    .flags = 0,
+    .arg = G_OPTION_ARG_FILENAME,
+    .arg_data = &opt_daemon,
+    .description = "Path to the xdg-desktop-portal-holo executable",
+    .arg_description = "PATH",
+  },
+  {
+    .long_name = "iterations",
+    .short_name = 'n',
+    .flags = 0,
+    .arg = G_OPTION_ARG_INT,
+    .arg_data = &opt_iterations,
+    .description = "Number of configuration writes",
+    .arg_description = "N",
+  },
+  {
+    .long_name = "rate",
+    .short_name = 0,
+    .flags = 0,
+    .arg = G_OPTION_ARG_DOUBLE,
+    .arg_data = &opt_rate,
+    .description = "Maximum number of writes per second",
+    .arg_description = "HZ",
+  },
+  {
+    .long_name = "in-place",
+    .short_name = 0,
+    .flags = 0,
+    .arg = G_OPTION_ARG_NONE,
+    .arg_data = &opt_in_place,
+    .description = "Rewrite the files in place instead of renaming over them",
+    .arg_description = NULL,
+  },
+  {
+    .long_name = "files",
+    .short_name = 0,
+    .flags = 0,
+    .arg = G_OPTION_ARG_STRING,
+    .arg_data = &opt_files,
+    .description = "Which files to rewrite: settings, lockdown or both (default)",
+    .arg_description = "WHICH",
+  },
+  {
+    .long_name = "reload-delay",
+    .short_name = 0,
+    .flags = 0,
+    .arg = G_OPTION_ARG_INT,
+    .arg_data = &opt_reload_delay,
+    .description = "Reload delay passed to the portal",
+    .arg_description = "MSEC",
+  },
+  {
+    .long_name = "sample-every",
+    .short_name = 0,
+    .flags = 0,
+    .arg = G_OPTION_ARG_INT,
+    .arg_data = &opt_sample_every,
+    .description = "Sample the portal's memory and file descriptors every N writes",
+    .arg_description = "N",
+  },
+  {
+    .long_name = "output",
+    .short_name = 'o',
+    .flags = 0,
+    .arg = G_OPTION_ARG_FILENAME,
+    .arg_data = &opt_output,
+    .description = "Write the JSON report to FILE instead of standard output",
+    .arg_description = "FILE",
+  },
+  G_OPTION_ENTRY_NULL,
+};
+
+typedef enum
+{
+  TARGET_SETTINGS,
+  TARGET_LOCKDOWN,
+
+  N_TARGETS
+} Target;
+
+typedef struct
+{
+  /* The value written last, and whether its signal arrived */
+  int expected;
+  bool received;
+  guint n_writes;
+
+  /* Array<gint64>, in microseconds */
+  GArray *samples;
+  guint n_timeouts;
+} TargetState;
+
+typedef struct
+{
+  gint64 rss_kb;
+  guint n_fds;
+} ResourceSample;
+
+static TargetState targets[N_TARGETS];
+
+static char *
+settings_contents (int color_scheme)
+{
+  return g_strdup_printf ("[org.freedesktop.appearance]\n"
+                          "color-scheme=%d\n"
+                          "contrast=0\n"
+                          "accent-color=0.2;0.4;0.8\n",
+                          color_scheme);
+}
+
+/* The portal exposes the Printing key as the disable-printing property */
+static char *
+lockdown_contents (int printing)
+{
+  return g_strdup_printf ("[Lockdown]\n"
+                          "Printing=%s\n",
+                          printing ? "true" : "false");
+}
+
+static void
+on_setting_changed (GDBusConnection *connection,
+                    const char *sender_name,
+                    const char *object_path,
+                    const char *interface_name,
+                    const char *signal_name,
+                    GVariant *parameters,
+                    gpointer user_data)
+{
+  const char *namespace;
+  const char *key;
+  g_autoptr (GVariant) value = NULL;
+
+  g_variant_get (parameters, "(&s&sv)", &namespace, &key, &value);
+
+  if (g_strcmp0 (namespace, "org.freedesktop.appearance") == 0 &&
+      g_strcmp0 (key, "color-scheme") == 0 &&
+      g_variant_is_of_type (value, G_VARIANT_TYPE_INT32) &&
+      g_variant_get_int32 (value) == targets[TARGET_SETTINGS].expected)
+    targets[TARGET_SETTINGS].received = true;
+}
+
+static void
+on_properties_changed (GDBusConnection *connection,
+                       const char *sender_name,
+                       const char *object_path,
+                       const char *interface_name,
+                       const char *signal_name,
+                       GVariant *parameters,
+                       gpointer user_data)
+{
+  const char *interface;
+  g_autoptr (GVariant) changed = NULL;
+  gboolean disable_printing;
+
+  g_variant_get (parameters, "(&s@a{sv}as)", &interface, &changed, NULL);
+
+  if (g_strcmp0 (interface, "org.freedesktop.impl.portal.Lockdown") == 0 &&
+      g_variant_lookup (changed, "disable-printing", "b", &disable_printing) &&
+      disable_printing == targets[TARGET_LOCKDOWN].expected)
+    targets[TARGET_LOCKDOWN].received = true;
+}
+
+static bool
+sample_resources (GPid pid,
+                  ResourceSample *sample)
+{
+  g_autofree char *status_path = g_strdup_printf ("/proc/%d/status", pid);
+  g_autofree char *fd_path = g_strdup_printf ("/proc/%d/fd", pid);
+  g_autofree char *status = NULL;
+
+  if (!g_file_get_contents (status_path, &status, NULL, NULL))
+    return false;
+
+  sample->rss_kb = -1;
+
+  for (const char *line = status; line != NULL && *line != '\0'; )
+    {
+      if (g_str_has_prefix (line, "VmRSS:"))
+        {
+          sample->rss_kb = g_ascii_strtoll (line + strlen ("VmRSS:"), NULL, 10);
+          break;
+        }
+
+      line = strchr (line, '\n');
+      if (line != NULL)
+        line++;
+    }
+
+  g_autoptr (GDir) dir = g_dir_open (fd_path, 0, NULL);
+  if (dir == NULL)
+    return false;
+
+  sample->n_fds = 0;
+  while (g_dir_read_name (dir) != NULL)
+    sample->n_fds++;
+
+  return true;
+}
+
+/* Writes the next value of @target, and waits for the matching signal */
+static bool
+bench_write (BenchFixture *fixture,
+             Target target,
+             GError **error)
+{
+  TargetState *state = &targets[target];
+  g_autofree char *contents = NULL;
+  const char *basename;
+
+  /* Both files start with 0, so that every write changes the value */
+  state->expected = target == TARGET_SETTINGS ? 1 + state->n_writes % 2 : (state->n_writes + 1) % 2;
+  state->received = false;
+  state->n_writes++;
+
+  if (target == TARGET_SETTINGS)
+    {
+      basename = "settings.conf";
+      contents = settings_contents (state->expected);
+    }
+  else
+    {
+      basename = "lockdown.conf";
+      contents = lockdown_contents (state->expected);
+    }
+
+  gint64 start = g_get_monotonic_time ();
+
+  if (!bench_fixture_write_config (fixture, basename, contents, !opt_in_place, error))
+    return false;
+
+  while (!state->received && g_get_monotonic_time () - start < SIGNAL_TIMEOUT_USEC)
+    g_main_context_iteration (NULL, TRUE);
+
+  if (state->received)
+    {
+      gint64 latency = g_get_monotonic_time () - start;
+
+      g_array_append_val (state->samples, latency);
+    }
+  else
+    {
+      state->n_timeouts++;
+    }
+
+  return true;
+}
+
+static gboolean
+on_timeout (gpointer user_data)
+{
+  /* Only wakes up g_main_context_iteration() */
+  return G_SOURCE_CONTINUE;
+}
+
+int
+main (int argc,
+      char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  g_autoptr (GError) error = NULL;
+
+  g_autoptr (GOptionContext) opt_context = g_option_context_new (" - Benchmark the Holo portal configuration reloads");
+  g_option_context_set_summary (opt_context,
+                                "Starts the portal on a private bus, rewrites its configuration\n"
+                                "files, times each write until the matching signal arrives, and\n"
+                                "samples the portal's memory and file descriptors along the way.");
+  g_option_context_add_main_entries (opt_context, opt_entries, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &error))
+    {
+      g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+      return EXIT_FAILURE;
+    }
+
+  bool use_target[N_TARGETS] = {
+    opt_files == NULL || g_str_equal (opt_files, "both") || g_str_equal (opt_files, "settings"),
+    opt_files == NULL || g_str_equal (opt_files, "both") || g_str_equal (opt_files, "lockdown"),
+  };
+
+  if (opt_daemon == NULL || opt_iterations < 1 || opt_rate <= 0 || opt_sample_every < 1 ||
+      (!use_target[TARGET_SETTINGS] && !use_target[TARGET_LOCKDOWN]))
+    {
+      g_printerr ("%s: invalid arguments, see --help\n", g_get_prgname ());
+      return EXIT_FAILURE;
+    }
+
+  g_autofree char *settings_conf = settings_contents (0);
+  g_autofree char *lockdown_conf = lockdown_contents (0);
+  g_autofree char *reload_delay_arg = NULL;
+  const char *daemon_args[2] = { NULL, };
+
+  if (opt_reload_delay >= 0)
+    {
+      reload_delay_arg = g_strdup_printf ("--reload-delay=%d", opt_reload_delay);
+      daemon_args[0] = reload_delay_arg;
+    }
+
+  g_autoptr (BenchFixture) fixture = bench_fixture_new (opt_daemon, daemon_args, settings_conf, lockdown_conf, &error);
+  if (fixture == NULL)
+    {
+      g_printerr ("Unable to start the portal: %s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  GPid pid = (GPid) g_ascii_strtoll (g_subprocess_get_identifier (fixture->daemon), NULL, 10);
+
+  guint setting_changed_id =
+    g_dbus_connection_signal_subscribe (fixture->connection,
+                                        BENCH_PORTAL_NAME,
+                                        "org.freedesktop.impl.portal.Settings",
+                                        "SettingChanged",
+                                        BENCH_PORTAL_PATH,
+                                        NULL,
+                                        G_DBUS_SIGNAL_FLAGS_NONE,
+                                        on_setting_changed,
+                                        NULL,
+                                        NULL);
+  guint properties_changed_id =
+    g_dbus_connection_signal_subscribe (fixture->connection,
+                                        BENCH_PORTAL_NAME,
+                                        "org.freedesktop.DBus.Properties",
+                                        "PropertiesChanged",
+                                        BENCH_PORTAL_PATH,
+                                        NULL,
+                                        G_DBUS_SIGNAL_FLAGS_NONE,
+                                        on_properties_changed,
+                                        NULL,
+                                        NULL);
+
+  /* Make sure that the match rules are in place before the first write */
+  g_dbus_connection_flush_sync (fixture->connection, NULL, NULL);
+
+  guint timeout_id = g_timeout_add (100, on_timeout, NULL);
+
+  for (size_t i = 0; i < N_TARGETS; i++)
+    targets[i].samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  g_autoptr (GArray) resources = g_array_new (FALSE, FALSE, sizeof (ResourceSample));
+  ResourceSample sample;
+  gint64 interval = (gint64) (G_USEC_PER_SEC / opt_rate);
+  gint64 start = g_get_monotonic_time ();
+
+  if (sample_resources (pid, &sample))
+    g_array_append_val (resources, sample);
+
+  for (int i = 0; i < opt_iterations; i++)
+    {
+      gint64 next = start + (i + 1) * interval;
+      Target target = use_target[TARGET_SETTINGS] && use_target[TARGET_LOCKDOWN]
+                      ? (Target) (i % N_TARGETS)
+                      : use_target[TARGET_SETTINGS] ? TARGET_SETTINGS : TARGET_LOCKDOWN;
+
+      if (!bench_write (fixture, target, &error))
+        {
+          g_printerr ("Unable to write the configuration: %s\n", error->message);
+          return EXIT_FAILURE;
+        }
+
+      if ((i + 1) % opt_sample_every == 0 && sample_resources (pid, &sample))
+        g_array_append_val (resources, sample);
+
+      gint64 now = g_get_monotonic_time ();
+      if (now < next)
+        g_usleep (next - now);
+    }
+
+  double duration = (double) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+  g_source_remove (timeout_id);
+  g_dbus_connection_signal_unsubscribe (fixture->connection, setting_changed_id);
+  g_dbus_connection_signal_unsubscribe (fixture->connection, properties_changed_id);
+
+  g_autoptr (GString) json = g_string_new (NULL);
+  const char *target_names[N_TARGETS] = { "settings", "lockdown" };
+  bool first = true;
+
+  g_string_append_printf (json,
+                          "{\n  \"benchmark\": \"reload\",\n  \"iterations\": %d,\n"
+                          "  \"rate_hz\": %.1f,\n  \"atomic\": %s,\n  \"duration_s\": %.3f,\n"
+                          "  \"results\": [\n",
+                          opt_iterations,
+                          opt_rate,
+                          opt_in_place ? "false" : "true",
+                          duration);
+
+  for (size_t i = 0; i < N_TARGETS; i++)
+    {
+      if (!use_target[i])
+        continue;
+
+      if (!first)
+        g_string_append (json, ",\n");
+      first = false;
+
+      g_string_append_printf (json,
+                              "    { \"name\": \"%s\", \"signals\": %u, \"timeouts\": %u, \"latency_us\": ",
+                              target_names[i],
+                              targets[i].samples->len,
+                              targets[i].n_timeouts);
+      bench_json_append_latencies (json, targets[i].samples);
+      g_string_append (json, " }");
+
+      g_array_unref (targets[i].samples);
+    }
+
+  g_string_append (json, "\n  ],\n  \"resources\": [\n");
+
+  for (guint i = 0; i < resources->len; i++)
+    {
+      const ResourceSample *s = &g_array_index (resources, ResourceSample, i);
+
+      g_string_append_printf (json,
+                              "    { \"rss_kb\": %" G_GINT64_FORMAT ", \"fds\": %u }%s\n",
+                              s->rss_kb,
+                              s->n_fds,
+                              i + 1 < resources->len ? "," : "");
+    }
+
+  g_string_append (json, "  ]");
+
+  if (resources->len > 0)
+    {
+      const ResourceSample *s_first = &g_array_index (resources, ResourceSample, 0);
+      const ResourceSample *s_last = &g_array_index (resources, ResourceSample, resources->len - 1);
+
+      g_string_append_printf (json,
+                              ",\n  \"rss_drift_kb\": %" G_GINT64_FORMAT ",\n  \"fd_drift\": %d",
+                              s_last->rss_kb - s_first->rss_kb,
+                              (int) s_last->n_fds - (int) s_first->n_fds);
+    }
+
+  g_string_append (json, "\n}\n");
+
+  if (opt_output != NULL)
+    {
+      if (!g_file_set_contents (opt_output, json->str, json->len, &error))
+        {
+          g_printerr ("Unable to write %s: %s\n", opt_output, error->message);
+          return EXIT_FAILURE;
+        }
+    }
+  else
+    {
+      fputs (json->str, stdout);
+    }
+
+  return EXIT_SUCCESS;
+}
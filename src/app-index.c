@@ -0,0 +1,797 @@
+// app-index.c: Index of the applications handling each content type
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "config.h"
+
+#include "app-index.h"
+
+/* Installing or removing an application usually touches several files,
+ * followed by a rewrite of mimeinfo.cache; they are gathered into one
+ * update at the end of this window */
+#define UPDATE_DELAY_MS 500
+
+#define MIMEAPPS_LIST "mimeapps.list"
+#define MIMEINFO_CACHE "mimeinfo.cache"
+
+/* Associations, as found in mimeapps.list; each is a
+ * HashTable<owned str content type, GStrv desktop IDs> */
+typedef struct
+{
+  GHashTable *defaults;
+  GHashTable *added;
+  GHashTable *removed;
+} MimeAppsList;
+
+/* A watched directory: either a configuration directory, which may only
+ * contain mimeapps.list, or the applications subdirectory of a data
+ * directory */
+typedef struct
+{
+  AppIndex *index;
+
+  char *path;
+  bool is_data_dir;
+  GFileMonitor *monitor;
+
+  /* HashTable<owned str path, GFileMonitor>, for the subdirectories of a
+   * data directory, whose desktop files are indexed as well */
+  GHashTable *subdirs;
+
+  /* Whether the contents need to be loaded again */
+  bool dirty;
+
+  /* NULL if there is no mimeapps.list */
+  MimeAppsList *mimeapps;
+
+  /* HashTable<owned str desktop ID, bool visible>, for data directories */
+  GHashTable *apps;
+
+  /* HashTable<owned str content type, GStrv desktop IDs>, from
+   * mimeinfo.cache or, failing that, from the desktop files */
+  GHashTable *cache;
+} AppIndexDir;
+
+/* The handlers of one content type, best first */
+typedef struct
+{
+  /* Array<owned str desktop ID>, since the directory tables they come from
+   * get replaced without ranking every content type again */
+  GPtrArray *ids;
+
+  /* HashTable<unowned str desktop ID, guint rank> */
+  GHashTable *ranks;
+} AppHandlers;
+
+struct _AppIndex
+{
+  /* Array<AppIndexDir>, in priority order */
+  GPtrArray *dirs;
+
+  /* HashTable<owned str desktop ID, AppIndexDir>, pointing to the data
+   * directory providing each application, or to NULL if it is hidden */
+  GHashTable *installed;
+
+  /* HashTable<owned str content type, AppHandlers> */
+  GHashTable *handlers;
+
+  guint update_id;
+};
+
+static AppIndex *default_index;
+
+static GHashTable *
+string_lists_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_strfreev);
+}
+
+/* Returns every list of @group, by key */
+static GHashTable *
+key_file_get_string_lists (GKeyFile *kf,
+                           const char *group)
+{
+  GHashTable *lists = string_lists_new ();
+  g_auto (GStrv) keys = g_key_file_get_keys (kf, group, NULL, NULL);
+
+  for (size_t i = 0; keys != NULL && keys[i] != NULL; i++)
+    {
+      char **ids = g_key_file_get_string_list (kf, group, keys[i], NULL, NULL);
+
+      if (ids != NULL)
+        g_hash_table_insert (lists, g_strdup (keys[i]), ids);
+    }
+
+  return lists;
+}
+
+static inline void
+touch_content_type (GHashTable *touched,
+                    const char *content_type)
+{
+  if (!g_hash_table_contains (touched, content_type))
+    g_hash_table_add (touched, g_strdup (content_type));
+}
+
+/* Adds the content types whose list differs between @old_lists and
+ * @new_lists, either of which may be NULL, to @touched */
+static void
+string_lists_diff (GHashTable *old_lists,
+                   GHashTable *new_lists,
+                   GHashTable *touched)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  if (old_lists != NULL)
+    {
+      g_hash_table_iter_init (&iter, old_lists);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          const char * const *new_ids = new_lists != NULL ? g_hash_table_lookup (new_lists, key) : NULL;
+
+          if (new_ids == NULL || !g_strv_equal (value, new_ids))
+            touch_content_type (touched, key);
+        }
+    }
+
+  if (new_lists != NULL)
+    {
+      g_hash_table_iter_init (&iter, new_lists);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          if (old_lists == NULL || !g_hash_table_contains (old_lists, key))
+            touch_content_type (touched, key);
+        }
+    }
+}
+
+static void
+mime_apps_list_free (MimeAppsList *list)
+{
+  g_hash_table_unref (list->defaults);
+  g_hash_table_unref (list->added);
+  g_hash_table_unref (list->removed);
+  g_free (list);
+}
+
+static MimeAppsList *
+mime_apps_list_load (const char *dir)
+{
+  g_autofree char *path = g_build_filename (dir, MIMEAPPS_LIST, NULL);
+  g_autoptr (GKeyFile) kf = g_key_file_new ();
+  g_autoptr (GError) error = NULL;
+
+  if (!g_key_file_load_from_file (kf, path, G_KEY_FILE_NONE, &error))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_debug ("Unable to load %s: %s", path, error->message);
+      return NULL;
+    }
+
+  MimeAppsList *list = g_new0 (MimeAppsList, 1);
+  list->defaults = key_file_get_string_lists (kf, "Default Applications");
+  list->added = key_file_get_string_lists (kf, "Added Associations");
+  list->removed = key_file_get_string_lists (kf, "Removed Associations");
+
+  return list;
+}
+
+static void
+mime_apps_list_diff (MimeAppsList *old_list,
+                     MimeAppsList *new_list,
+                     GHashTable *touched)
+{
+  string_lists_diff (old_list != NULL ? old_list->defaults : NULL,
+                     new_list != NULL ? new_list->defaults : NULL,
+                     touched);
+  string_lists_diff (old_list != NULL ? old_list->added : NULL,
+                     new_list != NULL ? new_list->added : NULL,
+                     touched);
+  string_lists_diff (old_list != NULL ? old_list->removed : NULL,
+                     new_list != NULL ? new_list->removed : NULL,
+                     touched);
+}
+
+static void app_index_dir__monitor__changed (GFileMonitor *monitor,
+                                             GFile *file,
+                                             GFile *other_file,
+                                             GFileMonitorEvent event_type,
+                                             gpointer user_data);
+
+static GFileMonitor *
+app_index_dir_monitor (AppIndexDir *dir,
+                       const char *path)
+{
+  g_autoptr (GFile) file = g_file_new_for_path (path);
+  g_autoptr (GError) error = NULL;
+
+  /* This also works for directories that do not exist yet */
+  GFileMonitor *monitor = g_file_monitor_directory (file, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+  if (monitor == NULL)
+    {
+      g_debug ("Unable to monitor %s: %s", path, error->message);
+      return NULL;
+    }
+
+  g_signal_connect (monitor, "changed", G_CALLBACK (app_index_dir__monitor__changed), dir);
+
+  return monitor;
+}
+
+static void
+file_monitor_free (gpointer data)
+{
+  GFileMonitor *monitor = data;
+
+  if (monitor != NULL)
+    {
+      g_signal_handlers_disconnect_matched (monitor, G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
+                                            (gpointer) app_index_dir__monitor__changed, NULL);
+      g_file_monitor_cancel (monitor);
+      g_object_unref (monitor);
+    }
+}
+
+static GHashTable *
+subdirs_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, g_free, file_monitor_free);
+}
+
+static void
+app_index_dir_clear (AppIndexDir *dir)
+{
+  g_clear_pointer (&dir->mimeapps, mime_apps_list_free);
+  g_clear_pointer (&dir->apps, g_hash_table_unref);
+  g_clear_pointer (&dir->cache, g_hash_table_unref);
+  g_clear_pointer (&dir->subdirs, g_hash_table_unref);
+}
+
+/* Returns whether the desktop file is visible, and adds the content types it
+ * handles to @types, a HashTable<owned str, Array<owned str>> */
+static bool
+load_desktop_file (const char *path,
+                   const char *desktop_id,
+                   GHashTable *types)
+{
+  g_autoptr (GKeyFile) kf = g_key_file_new ();
+
+  if (!g_key_file_load_from_file (kf, path, G_KEY_FILE_NONE, NULL))
+    return false;
+
+  if (g_key_file_get_boolean (kf, G_KEY_FILE_DESKTOP_GROUP, G_KEY_FILE_DESKTOP_KEY_HIDDEN, NULL))
+    return false;
+
+  g_auto (GStrv) mime_types = g_key_file_get_string_list (kf,
+                                                          G_KEY_FILE_DESKTOP_GROUP,
+                                                          G_KEY_FILE_DESKTOP_KEY_MIME_TYPE,
+                                                          NULL,
+                                                          NULL);
+
+  for (size_t i = 0; mime_types != NULL && mime_types[i] != NULL; i++)
+    {
+      GPtrArray *ids = g_hash_table_lookup (types, mime_types[i]);
+
+      if (ids == NULL)
+        {
+          ids = g_ptr_array_new_null_terminated (1, g_free, TRUE);
+          g_hash_table_insert (types, g_strdup (mime_types[i]), ids);
+        }
+
+      g_ptr_array_add (ids, g_strdup (desktop_id));
+    }
+
+  return true;
+}
+
+/* Lists the desktop files below @path; they only get parsed if @types is
+ * not NULL, i.e. when there is no mimeinfo.cache to rely on. The monitors
+ * of the subdirectories that are still there are taken from @old_subdirs */
+static void
+app_index_dir_scan (AppIndexDir *dir,
+                    const char *path,
+                    const char *prefix,
+                    GHashTable *types,
+                    GHashTable *old_subdirs)
+{
+  g_autoptr (GDir) d = g_dir_open (path, 0, NULL);
+  const char *name;
+
+  if (d == NULL)
+    return;
+
+  while ((name = g_dir_read_name (d)) != NULL)
+    {
+      g_autofree char *child = g_build_filename (path, name, NULL);
+
+      if (g_str_has_suffix (name, ".desktop"))
+        {
+          char *desktop_id = g_strconcat (prefix, name, NULL);
+          bool visible = types == NULL || load_desktop_file (child, desktop_id, types);
+
+          g_hash_table_insert (dir->apps, desktop_id, GINT_TO_POINTER (visible));
+        }
+      else if (g_file_test (child, G_FILE_TEST_IS_DIR))
+        {
+          /* Subdirectories are part of the desktop ID */
+          g_autofree char *child_prefix = g_strconcat (prefix, name, "-", NULL);
+          g_autofree char *old_path = NULL;
+          gpointer monitor = NULL;
+
+          if (old_subdirs == NULL ||
+              !g_hash_table_steal_extended (old_subdirs, child, (gpointer *) &old_path, &monitor))
+            monitor = app_index_dir_monitor (dir, child);
+
+          g_hash_table_insert (dir->subdirs, g_strdup (child), monitor);
+
+          app_index_dir_scan (dir, child, child_prefix, types, old_subdirs);
+        }
+    }
+}
+
+/* Loads the contents of @dir again, and adds the content types whose
+ * associations changed since the last load to @touched, unless it is
+ * NULL */
+static void
+app_index_dir_load (AppIndexDir *dir,
+                    GHashTable *touched)
+{
+  g_autoptr (GHashTable) old_subdirs = g_steal_pointer (&dir->subdirs);
+  g_autoptr (GHashTable) old_cache = g_steal_pointer (&dir->cache);
+  MimeAppsList *old_mimeapps = g_steal_pointer (&dir->mimeapps);
+
+  app_index_dir_clear (dir);
+  dir->dirty = false;
+  dir->subdirs = subdirs_new ();
+  dir->mimeapps = mime_apps_list_load (dir->path);
+
+  if (touched != NULL)
+    mime_apps_list_diff (old_mimeapps, dir->mimeapps, touched);
+
+  g_clear_pointer (&old_mimeapps, mime_apps_list_free);
+
+  if (!dir->is_data_dir)
+    return;
+
+  dir->apps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  g_autofree char *cache_path = g_build_filename (dir->path, MIMEINFO_CACHE, NULL);
+  g_autoptr (GKeyFile) kf = g_key_file_new ();
+
+  if (g_key_file_load_from_file (kf, cache_path, G_KEY_FILE_NONE, NULL))
+    {
+      dir->cache = key_file_get_string_lists (kf, "MIME Cache");
+      app_index_dir_scan (dir, dir->path, "", NULL, old_subdirs);
+    }
+  else
+    {
+      g_autoptr (GHashTable) types =
+        g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
+      GHashTableIter iter;
+      gpointer key, value;
+
+      app_index_dir_scan (dir, dir->path, "", types, old_subdirs);
+
+      dir->cache = string_lists_new ();
+      g_hash_table_iter_init (&iter, types);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          g_hash_table_iter_steal (&iter);
+          g_hash_table_insert (dir->cache, key, g_ptr_array_free (value, FALSE));
+        }
+    }
+
+  if (touched != NULL)
+    string_lists_diff (old_cache, dir->cache, touched);
+
+  g_debug ("Indexed %u applications and %u content types in %s",
+           g_hash_table_size (dir->apps), g_hash_table_size (dir->cache), dir->path);
+}
+
+static void app_index_queue_update (AppIndex *self);
+
+static bool
+app_index_dir_is_indexed_file (AppIndexDir *dir,
+                               GFile *file,
+                               GFileMonitorEvent event_type)
+{
+  const char *path = g_file_peek_path (file);
+  g_autofree char *name = g_file_get_basename (file);
+
+  /* The directory itself, or one of its subdirectories, came or went */
+  if (g_strcmp0 (path, dir->path) == 0 ||
+      (dir->subdirs != NULL && g_hash_table_contains (dir->subdirs, path)))
+    return true;
+
+  if (g_str_equal (name, MIMEAPPS_LIST))
+    return true;
+
+  if (!dir->is_data_dir)
+    return false;
+
+  if (g_str_equal (name, MIMEINFO_CACHE) || g_str_has_suffix (name, ".desktop"))
+    return true;
+
+  /* New subdirectories need to be scanned, and watched */
+  return (event_type == G_FILE_MONITOR_EVENT_CREATED ||
+          event_type == G_FILE_MONITOR_EVENT_MOVED_IN ||
+          event_type == G_FILE_MONITOR_EVENT_RENAMED) &&
+         g_file_query_file_type (file, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL) == G_FILE_TYPE_DIRECTORY;
+}
+
+static void
+app_index_dir__monitor__changed (GFileMonitor *monitor,
+                                 GFile *file,
+                                 GFile *other_file,
+                                 GFileMonitorEvent event_type,
+                                 gpointer user_data)
+{
+  AppIndexDir *dir = user_data;
+
+  if (event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+    return;
+
+  if (app_index_dir_is_indexed_file (dir, file, event_type) ||
+      (other_file != NULL && app_index_dir_is_indexed_file (dir, other_file, event_type)))
+    {
+      dir->dirty = true;
+      app_index_queue_update (dir->index);
+    }
+}
+
+static AppIndexDir *
+app_index_dir_new (AppIndex *index,
+                   char *path,
+                   bool is_data_dir)
+{
+  AppIndexDir *dir = g_new0 (AppIndexDir, 1);
+
+  dir->index = index;
+  dir->path = path;
+  dir->is_data_dir = is_data_dir;
+  dir->monitor = app_index_dir_monitor (dir, dir->path);
+
+  app_index_dir_load (dir, NULL);
+
+  return dir;
+}
+
+static void
+app_index_dir_free (gpointer data)
+{
+  if (data != NULL)
+    {
+      AppIndexDir *dir = data;
+
+      g_clear_pointer (&dir->monitor, file_monitor_free);
+      app_index_dir_clear (dir);
+      g_free (dir->path);
+      g_free (dir);
+    }
+}
+
+static void
+app_handlers_free (gpointer data)
+{
+  AppHandlers *handlers = data;
+
+  g_ptr_array_unref (handlers->ids);
+  g_hash_table_unref (handlers->ranks);
+  g_free (handlers);
+}
+
+static void
+app_handlers_add (AppHandlers *handlers,
+                  AppIndex *self,
+                  const char *desktop_id,
+                  AppIndexDir *provider)
+{
+  AppIndexDir *installed = g_hash_table_lookup (self->installed, desktop_id);
+
+  /* Entries of mimeinfo.cache only count for the applications that are not
+   * shadowed by another data directory */
+  if (installed == NULL || (provider != NULL && installed != provider))
+    return;
+
+  if (g_hash_table_contains (handlers->ranks, desktop_id))
+    return;
+
+  char *id = g_strdup (desktop_id);
+
+  g_hash_table_insert (handlers->ranks, id, GUINT_TO_POINTER (handlers->ids->len));
+  g_ptr_array_add (handlers->ids, id);
+}
+
+/* Ranks the handlers of @content_type as described by the MIME
+ * applications associations specification: defaults first, then added
+ * associations, then the cache, leaving out removed associations */
+static AppHandlers *
+app_index_rank_handlers (AppIndex *self,
+                         const char *content_type)
+{
+  AppHandlers *handlers = g_new0 (AppHandlers, 1);
+  g_autoptr (GHashTable) removed = g_hash_table_new (g_str_hash, g_str_equal);
+
+  handlers->ids = g_ptr_array_new_with_free_func (g_free);
+  handlers->ranks = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (guint i = 0; i < self->dirs->len; i++)
+    {
+      AppIndexDir *dir = g_ptr_array_index (self->dirs, i);
+      const char * const *ids;
+
+      if (dir->mimeapps == NULL)
+        continue;
+
+      ids = g_hash_table_lookup (dir->mimeapps->defaults, content_type);
+      for (size_t j = 0; ids != NULL && ids[j] != NULL; j++)
+        app_handlers_add (handlers, self, ids[j], NULL);
+    }
+
+  for (guint i = 0; i < self->dirs->len; i++)
+    {
+      AppIndexDir *dir = g_ptr_array_index (self->dirs, i);
+      const char * const *ids;
+
+      if (dir->mimeapps == NULL)
+        continue;
+
+      ids = g_hash_table_lookup (dir->mimeapps->added, content_type);
+      for (size_t j = 0; ids != NULL && ids[j] != NULL; j++)
+        {
+          if (!g_hash_table_contains (removed, ids[j]))
+            app_handlers_add (handlers, self, ids[j], NULL);
+        }
+
+      /* Removals only apply to the lists of lower priority */
+      ids = g_hash_table_lookup (dir->mimeapps->removed, content_type);
+      for (size_t j = 0; ids != NULL && ids[j] != NULL; j++)
+        g_hash_table_add (removed, (gpointer) ids[j]);
+    }
+
+  for (guint i = 0; i < self->dirs->len; i++)
+    {
+      AppIndexDir *dir = g_ptr_array_index (self->dirs, i);
+      const char * const *ids;
+
+      if (dir->cache == NULL)
+        continue;
+
+      ids = g_hash_table_lookup (dir->cache, content_type);
+      for (size_t j = 0; ids != NULL && ids[j] != NULL; j++)
+        {
+          if (!g_hash_table_contains (removed, ids[j]))
+            app_handlers_add (handlers, self, ids[j], dir);
+        }
+    }
+
+  return handlers;
+}
+
+/* Adds the content types listing any of @apps as a handler to @touched,
+ * or every content type if @apps is NULL */
+static void
+app_index_touch_handlers_of (AppIndex *self,
+                             GHashTable *apps,
+                             GHashTable *touched)
+{
+  for (guint i = 0; i < self->dirs->len; i++)
+    {
+      AppIndexDir *dir = g_ptr_array_index (self->dirs, i);
+      GHashTable *tables[] = {
+        dir->mimeapps != NULL ? dir->mimeapps->defaults : NULL,
+        dir->mimeapps != NULL ? dir->mimeapps->added : NULL,
+        dir->cache,
+      };
+
+      for (size_t t = 0; t < G_N_ELEMENTS (tables); t++)
+        {
+          GHashTableIter iter;
+          gpointer key, value;
+
+          if (tables[t] == NULL)
+            continue;
+
+          g_hash_table_iter_init (&iter, tables[t]);
+          while (g_hash_table_iter_next (&iter, &key, &value))
+            {
+              const char * const *ids = value;
+
+              if (g_hash_table_contains (touched, key))
+                continue;
+
+              for (size_t j = 0; ids[j] != NULL; j++)
+                {
+                  if (apps == NULL || g_hash_table_contains (apps, ids[j]))
+                    {
+                      touch_content_type (touched, key);
+                      break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* The first data directory providing an application wins, even if it
+ * hides it */
+static GHashTable *
+app_index_build_installed (AppIndex *self)
+{
+  GHashTable *installed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  for (guint i = 0; i < self->dirs->len; i++)
+    {
+      AppIndexDir *dir = g_ptr_array_index (self->dirs, i);
+      GHashTableIter iter;
+      gpointer key, value;
+
+      if (dir->apps == NULL)
+        continue;
+
+      g_hash_table_iter_init (&iter, dir->apps);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          if (!g_hash_table_contains (installed, key))
+            g_hash_table_insert (installed, g_strdup (key), GPOINTER_TO_INT (value) ? dir : NULL);
+        }
+    }
+
+  return installed;
+}
+
+/* Returns the applications that were installed, removed, hidden, shown or
+ * shadowed between @old_installed and @new_installed; the keys are owned
+ * by either table */
+static GHashTable *
+installed_diff (GHashTable *old_installed,
+                GHashTable *new_installed)
+{
+  GHashTable *changed = g_hash_table_new (g_str_hash, g_str_equal);
+  GHashTableIter iter;
+  gpointer key, value, new_value;
+
+  g_hash_table_iter_init (&iter, old_installed);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      if (!g_hash_table_lookup_extended (new_installed, key, NULL, &new_value) || new_value != value)
+        g_hash_table_add (changed, key);
+    }
+
+  g_hash_table_iter_init (&iter, new_installed);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      if (!g_hash_table_contains (old_installed, key))
+        g_hash_table_add (changed, key);
+    }
+
+  return changed;
+}
+
+/* Reads the directories that changed again, and only ranks the handlers
+ * of the content types whose associations, or handlers, changed */
+static void
+app_index_update (AppIndex *self)
+{
+  g_autoptr (GHashTable) touched = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_autoptr (GHashTable) installed = NULL;
+  GHashTableIter iter;
+  gpointer key;
+
+  for (guint i = 0; i < self->dirs->len; i++)
+    {
+      AppIndexDir *dir = g_ptr_array_index (self->dirs, i);
+
+      if (dir->dirty)
+        app_index_dir_load (dir, touched);
+    }
+
+  installed = app_index_build_installed (self);
+
+  if (self->handlers == NULL)
+    {
+      self->handlers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, app_handlers_free);
+      app_index_touch_handlers_of (self, NULL, touched);
+    }
+  else
+    {
+      g_autoptr (GHashTable) changed_apps = installed_diff (self->installed, installed);
+
+      if (g_hash_table_size (changed_apps) > 0)
+        app_index_touch_handlers_of (self, changed_apps, touched);
+    }
+
+  g_clear_pointer (&self->installed, g_hash_table_unref);
+  self->installed = g_steal_pointer (&installed);
+
+  g_hash_table_iter_init (&iter, touched);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      AppHandlers *handlers = app_index_rank_handlers (self, key);
+
+      if (handlers->ids->len > 0)
+        {
+          g_hash_table_replace (self->handlers, g_strdup (key), handlers);
+        }
+      else
+        {
+          g_hash_table_remove (self->handlers, key);
+          app_handlers_free (handlers);
+        }
+    }
+
+  g_debug ("Indexed %u applications handling %u content types, %u of them ranked again",
+           g_hash_table_size (self->installed), g_hash_table_size (self->handlers),
+           g_hash_table_size (touched));
+}
+
+static gboolean
+app_index__update__timeout (gpointer user_data)
+{
+  AppIndex *self = user_data;
+
+  self->update_id = 0;
+  app_index_update (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+app_index_queue_update (AppIndex *self)
+{
+  if (self->update_id == 0)
+    self->update_id = g_timeout_add (UPDATE_DELAY_MS, app_index__update__timeout, self);
+}
+
+static AppIndex *
+app_index_new (void)
+{
+  AppIndex *self = g_new0 (AppIndex, 1);
+
+  self->dirs = g_ptr_array_new_with_free_func (app_index_dir_free);
+
+  /* XDG_CONFIG_HOME, then XDG_CONFIG_DIRS, for mimeapps.list */
+  g_ptr_array_add (self->dirs, app_index_dir_new (self, g_strdup (g_get_user_config_dir ()), false));
+
+  const char * const *config_dirs = g_get_system_config_dirs ();
+  for (size_t i = 0; config_dirs[i] != NULL; i++)
+    g_ptr_array_add (self->dirs, app_index_dir_new (self, g_strdup (config_dirs[i]), false));
+
+  /* XDG_DATA_HOME/applications, then XDG_DATA_DIRS/applications */
+  g_ptr_array_add (self->dirs,
+                   app_index_dir_new (self, g_build_filename (g_get_user_data_dir (), "applications", NULL), true));
+
+  const char * const *data_dirs = g_get_system_data_dirs ();
+  for (size_t i = 0; data_dirs[i] != NULL; i++)
+    g_ptr_array_add (self->dirs,
+                     app_index_dir_new (self, g_build_filename (data_dirs[i], "applications", NULL), true));
+
+  app_index_update (self);
+
+  return self;
+}
+
+AppIndex *
+app_index_get_default (void)
+{
+  if (g_once_init_enter_pointer (&default_index))
+    g_once_init_leave_pointer (&default_index, app_index_new ());
+
+  return default_index;
+}
+
+int
+app_index_get_rank (AppIndex *self,
+                    const char *content_type,
+                    const char *desktop_id)
+{
+  AppHandlers *handlers = g_hash_table_lookup (self->handlers, content_type);
+  gpointer rank;
+
+  if (handlers == NULL || !g_hash_table_lookup_extended (handlers->ranks, desktop_id, NULL, &rank))
+    return -1;
+
+  return GPOINTER_TO_INT (rank);
+}
@@ -0,0 +1,28 @@
+// app-index.h: Index of the applications handling each content type
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#pragma once
+
+#include <gio/gio.h>
+#include <stdbool.h>
+
+G_BEGIN_DECLS
+
+typedef struct _AppIndex AppIndex;
+
+/* Returns the index, built on first use from mimeapps.list, mimeinfo.cache
+ * and the desktop files, and kept up to date as they change */
+AppIndex *
+app_index_get_default (void);
+
+/* Returns the rank of @desktop_id among the handlers of @content_type,
+ * 0 being the preferred one, or -1 if it does not handle it. URI schemes
+ * are looked up as x-scheme-handler/<scheme> */
+int
+app_index_get_rank (AppIndex *self,
+                    const char *content_type,
+                    const char *desktop_id);
+
+G_END_DECLS
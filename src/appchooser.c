@@ -6,48 +6,138 @@
 #include "config.h"
 
 #include "appchooser.h"
+#include "app-index.h"
+#include "rate-limit.h"
 #include "request.h"
+#include "uri-helper.h"
+#include "uri-router.h"
+
+#include <string.h>
 
 #include "utils.h"
 #include "xdg-desktop-portal-dbus.h"
 
+/* Returns the caller's choice that ranks best for @content_type, as a
+ * desktop ID, or NULL if none of them handles it */
+static char *
+rank_choices (AppIndex *index,
+              const char *content_type,
+              const char * const *choices)
+{
+  g_autofree char *best = NULL;
+  int best_rank = -1;
+
+  for (size_t i = 0; choices != NULL && choices[i] != NULL; i++)
+    {
+      g_autofree char *desktop_id = g_strconcat (choices[i], ".desktop", NULL);
+      int rank = app_index_get_rank (index, content_type, desktop_id);
+
+      if (rank >= 0 && (best_rank < 0 || rank < best_rank))
+        {
+          g_free (best);
+          best = g_steal_pointer (&desktop_id);
+          best_rank = rank;
+        }
+    }
+
+  return g_steal_pointer (&best);
+}
+
 static bool
 handle_choose_application (XdpImplAppChooser *object,
                            GDBusMethodInvocation *invocation,
                            const char *arg_handle,
                            const char *arg_app_id,
                            const char */*arg_parent_window*/,
-                           const char **/*choices*/,
-                           GVariant */*arg_options*/)
+                           const char **arg_choices,
+                           GVariant *arg_options)
 {
   const char *sender = g_dbus_method_invocation_get_sender (invocation);
-  g_autoptr(Request) request = request_new (sender, arg_app_id, arg_handle);
-  g_object_ref (request);
 
-  request_export (request, g_dbus_method_invocation_get_connection (invocation));
+  if (!rate_limiter_consume (rate_limiter_get_default (), arg_app_id))
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             XDG_DESKTOP_PORTAL_ERROR,
+                                             XDG_DESKTOP_PORTAL_ERROR_NOT_ALLOWED,
+                                             "Too many requests");
+      return true;
+    }
+
   // The frontend (xdg-desktop-portal) expects a request to be exported for the
-  // duration of the user interaction. There is no user interaction here.
-  request_unexport (request);
+  // duration of the user interaction. There is no user interaction here, so
+  // the request is only tracked, and never exported.
+  Request *request = request_acquire (sender, arg_app_id, arg_handle);
 
   guint response = 0;
-  GVariantBuilder opt_builder;
-  g_variant_builder_init (&opt_builder, G_VARIANT_TYPE_VARDICT);
+  GVariant *results = NULL;
+
+  const char *content_type = NULL;
+  g_variant_lookup (arg_options, "content_type", "&s", &content_type);
+
+  g_autoptr(UriHelper) helper = NULL;
+
+  // routing.conf takes precedence for the URI schemes it lists
+  if (content_type != NULL && g_str_has_prefix (content_type, "x-scheme-handler/"))
+    {
+      helper = uri_router_lookup_scheme (uri_router_get_default (),
+                                         content_type + strlen ("x-scheme-handler/"));
+      if (helper != NULL)
+        {
+          xdp_impl_app_chooser_complete_choose_application (object,
+                                                            invocation,
+                                                            0,
+                                                            helper->choose_results);
+          request_release (request);
+          return true;
+        }
+    }
+
+  helper = get_steam_uri_helper ();
+
+  // The Steam helper is preferred whenever it can handle the content, since
+  // it knows how to bring the application it starts to the foreground.
+  // Otherwise, the caller's choices are ranked by the user's associations,
+  // and the Steam helper is only a last resort.
+  if (content_type != NULL &&
+      (helper == NULL ||
+       app_index_get_rank (app_index_get_default (), content_type, g_app_info_get_id (helper->info)) < 0))
+    {
+      g_autofree char *desktop_id = rank_choices (app_index_get_default (),
+                                                  content_type,
+                                                  (const char * const *) arg_choices);
+
+      if (desktop_id != NULL)
+        {
+          g_autofree char *app_id = xdp_get_app_id_from_desktop_id (desktop_id);
+          GVariantBuilder opt_builder;
+
+          g_debug ("Choosing %s for %s", app_id, content_type);
+
+          g_variant_builder_init (&opt_builder, G_VARIANT_TYPE_VARDICT);
+          g_variant_builder_add (&opt_builder, "{sv}", "choice", g_variant_new_string (app_id));
+          results = g_variant_builder_end (&opt_builder);
+        }
+    }
 
-  g_autoptr(GAppInfo) info = get_steam_uri_helper ();
-  if (!info)
-    response = 2;
-  else
+  if (results == NULL)
     {
-      g_autofree char *app_id = xdp_get_app_id_from_desktop_id (g_app_info_get_id (info));
-      g_variant_builder_add (&opt_builder, "{sv}", "choice", g_variant_new_string (app_id));
+      if (!helper)
+        {
+          response = 2;
+          results = g_variant_new_array (G_VARIANT_TYPE ("{sv}"), NULL, 0);
+        }
+      else
+        {
+          results = helper->choose_results;
+        }
     }
 
   xdp_impl_app_chooser_complete_choose_application (object,
                                                     invocation,
                                                     response,
-                                                    g_variant_builder_end (&opt_builder));
+                                                    results);
 
-  g_object_unref (request);
+  request_release (request);
 
   return true;
 }
@@ -58,6 +148,8 @@ handle_update_choices (XdpImplAppChooser */*object*/,
                        const char */*arg_handle*/,
                        const char **/*choices*/)
 {
+  // ChooseApplication replies straight away, without any dialog, so there
+  // is never a pending choice left to update.
   g_dbus_method_invocation_return_error (invocation,
                                          XDG_DESKTOP_PORTAL_ERROR,
                                          XDG_DESKTOP_PORTAL_ERROR_NOT_ALLOWED,
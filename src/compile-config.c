@@ -0,0 +1,75 @@
+// compile-config.c: Compile the configuration into an image
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "config.h"
+
+#include "config-db.h"
+#include "config-source.h"
+
+#include "utils.h"
+
+#include <errno.h>
+#include <locale.h>
+#include <stdlib.h>
+#include <glib/gstdio.h>
+
+static char *opt_output;
+
+static GOptionEntry opt_entries[] = {
+  {
+    .long_name = "output",
+    .short_name = 'o',
+    .flags = 0,
+    .arg = G_OPTION_ARG_FILENAME,
+    .arg_data = &opt_output,
+    .description = "Write the image to FILE instead of the default location",
+    .arg_description = "FILE",
+  },
+  G_OPTION_ENTRY_NULL,
+};
+
+int
+main (int argc,
+      char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  g_autoptr (GError) error = NULL;
+
+  g_autoptr (GOptionContext) opt_context = g_option_context_new (" - Compile the Holo portal configuration");
+  g_option_context_set_summary (opt_context,
+                                "Compiles settings.conf and lockdown.conf into an image that\n"
+                                "xdg-desktop-portal-holo maps at startup instead of parsing them.");
+  g_option_context_add_main_entries (opt_context, opt_entries, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &error))
+    {
+      print_error ("%s: %s", g_get_prgname (), error->message);
+      return EXIT_FAILURE;
+    }
+
+  g_autofree char *output = opt_output != NULL ? g_strdup (opt_output) : config_db_get_default_path ();
+
+  g_autoptr (GVariant) db = config_db_compile (config_source_get_default (), &error);
+  if (db == NULL)
+    {
+      print_error ("Unable to compile the configuration: %s", error->message);
+      return EXIT_FAILURE;
+    }
+
+  g_autofree char *dir = g_path_get_dirname (output);
+  if (g_mkdir_with_parents (dir, 0755) != 0)
+    {
+      print_error ("Unable to create %s: %s", dir, g_strerror (errno));
+      return EXIT_FAILURE;
+    }
+
+  if (!g_file_set_contents (output, g_variant_get_data (db), g_variant_get_size (db), &error))
+    {
+      print_error ("Unable to write %s: %s", output, error->message);
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
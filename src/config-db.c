@@ -0,0 +1,253 @@
+// config-db.c: Precompiled configuration image
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "config.h"
+
+#include "config-db.h"
+#include "settings-registry.h"
+
+#include <string.h>
+
+/* The configuration files compiled into the image */
+static const char * const config_db_sources[] = {
+  "settings.conf",
+  "lockdown.conf",
+};
+
+static inline gint64
+stat_get_mtime_nsec (const GStatBuf *st)
+{
+  return (gint64) st->st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000) + st->st_mtim.tv_nsec;
+}
+
+char *
+config_db_get_default_path (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "xdg-desktop-portal-holo", "config.gvariant", NULL);
+}
+
+static GKeyFile *
+config_db_load_source (ConfigSource *source,
+                       const char *basename,
+                       GVariantBuilder *sources,
+                       GError **error)
+{
+  g_autoptr (GKeyFile) kf = g_key_file_new ();
+  GStatBuf st;
+  g_autofree char *path = config_source_lookup (source, basename, &st);
+
+  if (path == NULL)
+    {
+      g_variant_builder_add (sources, "(sstx)", basename, "", (guint64) 0, (gint64) 0);
+      return g_steal_pointer (&kf);
+    }
+
+  /* The file is stat'ed before being read, so that the image is considered
+   * stale if it gets modified in between */
+  if (!g_key_file_load_from_file (kf, path, G_KEY_FILE_NONE, error))
+    return NULL;
+
+  g_variant_builder_add (sources, "(sstx)", basename, path, (guint64) st.st_size, stat_get_mtime_nsec (&st));
+
+  return g_steal_pointer (&kf);
+}
+
+static GVariant *
+config_db_compile_settings (GKeyFile *kf)
+{
+  GVariantBuilder builder;
+  g_auto (GStrv) groups = g_key_file_get_groups (kf, NULL);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+
+  for (size_t i = 0; groups[i] != NULL; i++)
+    {
+      const SettingNamespaceInfo *ns_info = settings_registry_lookup_namespace (groups[i]);
+      GVariantBuilder dict;
+
+      if (ns_info == NULL)
+        continue;
+
+      g_variant_builder_init (&dict, G_VARIANT_TYPE ("a{sv}"));
+
+      for (size_t j = 0; j < ns_info->n_settings; j++)
+        {
+          const SettingInfo *info = &ns_info->settings[j];
+          SettingData data = { 0, };
+
+          info->parse (info, kf, &data);
+          g_variant_builder_add (&dict, "{sv}", info->key, info->serialize (&data));
+
+          if (info->value_type == SETTING_STRING_VALUE)
+            g_free (data.v_str);
+        }
+
+      g_variant_builder_add (&builder, "{s@a{sv}}", groups[i], g_variant_builder_end (&dict));
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+config_db_compile_lockdown (GKeyFile *kf)
+{
+  GVariantBuilder builder;
+  g_auto (GStrv) groups = g_key_file_get_groups (kf, NULL);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sb}}"));
+
+  for (size_t i = 0; groups[i] != NULL; i++)
+    {
+      g_auto (GStrv) keys = g_key_file_get_keys (kf, groups[i], NULL, NULL);
+      GVariantBuilder dict;
+
+      g_variant_builder_init (&dict, G_VARIANT_TYPE ("a{sb}"));
+
+      for (size_t j = 0; keys != NULL && keys[j] != NULL; j++)
+        {
+          g_autoptr (GError) error = NULL;
+          gboolean value = g_key_file_get_boolean (kf, groups[i], keys[j], &error);
+
+          if (error == NULL)
+            g_variant_builder_add (&dict, "{sb}", keys[j], value);
+        }
+
+      g_variant_builder_add (&builder, "{s@a{sb}}", groups[i], g_variant_builder_end (&dict));
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+GVariant *
+config_db_compile (ConfigSource *source,
+                   GError **error)
+{
+  GVariantBuilder sources;
+
+  g_variant_builder_init (&sources, G_VARIANT_TYPE ("a(sstx)"));
+
+  g_autoptr (GKeyFile) settings = config_db_load_source (source, "settings.conf", &sources, error);
+  if (settings == NULL)
+    {
+      g_variant_builder_clear (&sources);
+      return NULL;
+    }
+
+  g_autoptr (GKeyFile) lockdown = config_db_load_source (source, "lockdown.conf", &sources, error);
+  if (lockdown == NULL)
+    {
+      g_variant_builder_clear (&sources);
+      return NULL;
+    }
+
+  return g_variant_ref_sink (g_variant_new ("(ss@a(sstx)@a{sa{sv}}@a{sa{sb}})",
+                                            CONFIG_DB_MAGIC,
+                                            settings_registry_get_checksum (),
+                                            g_variant_builder_end (&sources),
+                                            config_db_compile_settings (settings),
+                                            config_db_compile_lockdown (lockdown)));
+}
+
+static bool
+config_db_source_is_current (GVariant *sources,
+                             ConfigSource *source,
+                             const char *basename)
+{
+  GVariantIter iter;
+  const char *name;
+  const char *path;
+  guint64 size;
+  gint64 mtime_nsec;
+
+  g_variant_iter_init (&iter, sources);
+  while (g_variant_iter_next (&iter, "(&s&stx)", &name, &path, &size, &mtime_nsec))
+    {
+      if (strcmp (name, basename) != 0)
+        continue;
+
+      GStatBuf st;
+      g_autofree char *current_path = config_source_lookup (source, basename, &st);
+
+      if (current_path == NULL)
+        return path[0] == '\0';
+
+      return strcmp (path, current_path) == 0 &&
+             size == (guint64) st.st_size &&
+             mtime_nsec == stat_get_mtime_nsec (&st);
+    }
+
+  return false;
+}
+
+GVariant *
+config_db_open (const char *path,
+                ConfigSource *source,
+                GError **error)
+{
+  g_autoptr (GMappedFile) mapped = g_mapped_file_new (path, FALSE, error);
+  if (mapped == NULL)
+    return NULL;
+
+  /* The image is not trusted, so GVariant checks the serialized data as it
+   * gets accessed */
+  g_autoptr (GBytes) bytes = g_mapped_file_get_bytes (mapped);
+  g_autoptr (GVariant) db = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (CONFIG_DB_TYPE_STRING),
+                                                                          bytes,
+                                                                          FALSE));
+
+  const char *magic = NULL;
+  g_variant_get_child (db, CONFIG_DB_MAGIC_INDEX, "&s", &magic);
+  if (strcmp (magic, CONFIG_DB_MAGIC) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Not a configuration image");
+      return NULL;
+    }
+
+  const char *checksum = NULL;
+  g_variant_get_child (db, CONFIG_DB_CHECKSUM_INDEX, "&s", &checksum);
+  if (strcmp (checksum, settings_registry_get_checksum ()) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Image compiled against a different settings schema");
+      return NULL;
+    }
+
+  g_autoptr (GVariant) sources = g_variant_get_child_value (db, CONFIG_DB_SOURCES_INDEX);
+  for (size_t i = 0; i < G_N_ELEMENTS (config_db_sources); i++)
+    {
+      if (!config_db_source_is_current (sources, source, config_db_sources[i]))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Image is older than %s", config_db_sources[i]);
+          return NULL;
+        }
+    }
+
+  return g_steal_pointer (&db);
+}
+
+GVariant *
+config_db_get_default (void)
+{
+  static GVariant *db;
+  static bool loaded;
+
+  if (!loaded)
+    {
+      g_autofree char *path = config_db_get_default_path ();
+      g_autoptr (GError) error = NULL;
+
+      loaded = true;
+
+      db = config_db_open (path, config_source_get_default (), &error);
+      if (db == NULL)
+        g_debug ("Not using configuration image %s: %s", path, error->message);
+      else
+        g_debug ("Using configuration image: %s", path);
+    }
+
+  return db;
+}
@@ -0,0 +1,50 @@
+// config-db.h: Precompiled configuration image
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#pragma once
+
+#include "config-source.h"
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* The image is a single serialized GVariant of this type:
+ *
+ *  - s: CONFIG_DB_MAGIC
+ *  - s: the checksum of the settings registry it was compiled against
+ *  - a(sstx): the basename, path, size and mtime (in nanoseconds) of each
+ *    source configuration file; the path is empty if there was none
+ *  - a{sa{sv}}: the settings, as returned by Settings.ReadAll
+ *  - a{sa{sb}}: the boolean keys of lockdown.conf, by group
+ */
+#define CONFIG_DB_TYPE_STRING "(ssa(sstx)a{sa{sv}}a{sa{sb}})"
+#define CONFIG_DB_MAGIC "xdg-desktop-portal-holo-config-1"
+
+enum
+{
+  CONFIG_DB_MAGIC_INDEX,
+  CONFIG_DB_CHECKSUM_INDEX,
+  CONFIG_DB_SOURCES_INDEX,
+  CONFIG_DB_SETTINGS_INDEX,
+  CONFIG_DB_LOCKDOWN_INDEX,
+};
+
+char *
+config_db_get_default_path (void);
+
+GVariant *
+config_db_compile (ConfigSource *source,
+                   GError **error);
+
+GVariant *
+config_db_open (const char *path,
+                ConfigSource *source,
+                GError **error);
+
+GVariant *
+config_db_get_default (void);
+
+G_END_DECLS
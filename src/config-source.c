@@ -0,0 +1,784 @@
+// config-source.c: Shared configuration loading and reloading
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "config.h"
+
+#include "config-source.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+
+/* A single save usually results in a burst of file monitor events; they
+ * are gathered into one reload at the end of this window */
+#define DEFAULT_RELOAD_DELAY_MS 100
+
+static guint reload_delay_ms = DEFAULT_RELOAD_DELAY_MS;
+
+typedef enum
+{
+  CONFIG_UNKNOWN = 0,
+  CONFIG_PRESENT,
+  CONFIG_MISSING
+} ConfigPresence;
+
+/* A search directory, watched for configuration files appearing,
+ * changing, disappearing or being moved */
+typedef struct
+{
+  ConfigSource *source;
+  guint index;
+
+  char *path;
+  GFileMonitor *monitor;
+
+  /* Whether the directory exists */
+  ConfigPresence presence;
+
+  /* HashTable<unowned str, ConfigPresence>, as last seen through stat() or
+   * file monitor events */
+  GHashTable *files;
+} ConfigDir;
+
+typedef struct
+{
+  guint id;
+  ConfigSourceFunc func;
+  gpointer user_data;
+} ConfigSubscriber;
+
+typedef struct
+{
+  ConfigSource *source;
+
+  /* Interned */
+  const char *basename;
+
+  /* Array<ConfigSubscriber> */
+  GArray *subscribers;
+
+  /* Index of the directory containing the effective file, or G_MAXUINT */
+  guint effective_index;
+
+  guint reload_id;
+
+  /* Whether loading the file was attempted at all */
+  bool loaded;
+
+  /* Last loaded contents */
+  GKeyFile *key_file;
+
+  /* Fingerprint of the last loaded file */
+  char *path;
+  dev_t dev;
+  ino_t ino;
+  goffset size;
+  gint64 mtime_nsec;
+  char *checksum;
+
+  /* Keys to be written back by the next save; see config_source_save() */
+  GKeyFile *pending_changes;
+  bool saving;
+
+  guint n_reloads;
+  guint n_coalesced;
+  guint n_skipped;
+} ConfigFile;
+
+struct _ConfigSource
+{
+  /* Array<ConfigDir>, in priority order */
+  GPtrArray *dirs;
+
+  /* HashTable<unowned str, ConfigFile> */
+  GHashTable *files;
+
+  guint last_subscription_id;
+};
+
+static ConfigSource *default_source;
+
+void
+config_source_set_reload_delay (guint delay_ms)
+{
+  reload_delay_ms = delay_ms;
+}
+
+static inline ConfigPresence
+config_dir_get_file_presence (ConfigDir *dir,
+                              const char *basename)
+{
+  return GPOINTER_TO_INT (g_hash_table_lookup (dir->files, basename));
+}
+
+static inline void
+config_dir_set_file_presence (ConfigDir *dir,
+                              const char *basename,
+                              ConfigPresence presence)
+{
+  g_hash_table_insert (dir->files, (gpointer) basename, GINT_TO_POINTER (presence));
+}
+
+static void config_dir__monitor__changed (GFileMonitor *monitor,
+                                          GFile *file,
+                                          GFile *other_file,
+                                          GFileMonitorEvent event_type,
+                                          gpointer user_data);
+
+static ConfigDir *
+config_dir_new (ConfigSource *source,
+                guint index,
+                char *path)
+{
+  ConfigDir *dir = g_new0 (ConfigDir, 1);
+
+  dir->source = source;
+  dir->index = index;
+  dir->path = path;
+  dir->files = g_hash_table_new (NULL, NULL);
+
+  g_autoptr (GFile) file = g_file_new_for_path (dir->path);
+  g_autoptr (GError) error = NULL;
+
+  /* This also works for directories that do not exist yet */
+  dir->monitor = g_file_monitor_directory (file, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+  if (dir->monitor == NULL)
+    {
+      /* Nothing would tell when the directory or its files appear, so
+       * their absence is never cached */
+      g_debug ("Unable to monitor %s: %s", dir->path, error->message);
+      return dir;
+    }
+
+  g_signal_connect (dir->monitor, "changed", G_CALLBACK (config_dir__monitor__changed), dir);
+
+  /* Missing directories are remembered, so that looking up files in them
+   * does not need to hit the file system */
+  dir->presence = g_file_test (path, G_FILE_TEST_IS_DIR) ? CONFIG_PRESENT : CONFIG_MISSING;
+
+  return dir;
+}
+
+static void
+config_dir_free (gpointer data)
+{
+  if (data != NULL)
+    {
+      ConfigDir *dir = data;
+
+      if (dir->monitor != NULL)
+        {
+          g_signal_handlers_disconnect_by_data (dir->monitor, dir);
+          g_file_monitor_cancel (dir->monitor);
+          g_clear_object (&dir->monitor);
+        }
+
+      g_hash_table_unref (dir->files);
+      g_free (dir->path);
+      g_free (dir);
+    }
+}
+
+static ConfigFile *
+config_file_new (ConfigSource *source,
+                 const char *basename)
+{
+  ConfigFile *file = g_new0 (ConfigFile, 1);
+
+  file->source = source;
+  file->basename = g_intern_string (basename);
+  file->subscribers = g_array_new (FALSE, FALSE, sizeof (ConfigSubscriber));
+  file->effective_index = G_MAXUINT;
+
+  return file;
+}
+
+static void
+config_file_free (gpointer data)
+{
+  if (data != NULL)
+    {
+      ConfigFile *file = data;
+
+      g_clear_handle_id (&file->reload_id, g_source_remove);
+      g_clear_pointer (&file->key_file, g_key_file_unref);
+      g_clear_pointer (&file->pending_changes, g_key_file_unref);
+      g_array_unref (file->subscribers);
+      g_free (file->path);
+      g_free (file->checksum);
+      g_free (file);
+    }
+}
+
+/* Only stats the candidates whose presence is unknown, up to the first one
+ * that exists */
+static char *
+config_source_find (ConfigSource *self,
+                    const char *basename,
+                    GStatBuf *st,
+                    guint *index)
+{
+  basename = g_intern_string (basename);
+
+  for (guint i = 0; i < self->dirs->len; i++)
+    {
+      ConfigDir *dir = g_ptr_array_index (self->dirs, i);
+
+      if (dir->presence == CONFIG_MISSING ||
+          config_dir_get_file_presence (dir, basename) == CONFIG_MISSING)
+        continue;
+
+      g_autofree char *path = g_build_filename (dir->path, basename, NULL);
+
+      if (g_stat (path, st) == 0 && S_ISREG (st->st_mode))
+        {
+          if (dir->monitor != NULL)
+            config_dir_set_file_presence (dir, basename, CONFIG_PRESENT);
+          *index = i;
+          return g_steal_pointer (&path);
+        }
+
+      if (dir->monitor != NULL)
+        config_dir_set_file_presence (dir, basename, CONFIG_MISSING);
+    }
+
+  *index = G_MAXUINT;
+
+  return NULL;
+}
+
+static bool
+key_file_group_equal (GKeyFile *a,
+                      GKeyFile *b,
+                      const char *group)
+{
+  gsize n_keys_a = 0;
+  gsize n_keys_b = 0;
+  g_auto (GStrv) keys_a = g_key_file_get_keys (a, group, &n_keys_a, NULL);
+  g_auto (GStrv) keys_b = g_key_file_get_keys (b, group, &n_keys_b, NULL);
+
+  if (keys_a == NULL || keys_b == NULL || n_keys_a != n_keys_b)
+    return false;
+
+  for (gsize i = 0; i < n_keys_a; i++)
+    {
+      g_autofree char *value_a = g_key_file_get_value (a, group, keys_a[i], NULL);
+      g_autofree char *value_b = g_key_file_get_value (b, group, keys_a[i], NULL);
+
+      if (g_strcmp0 (value_a, value_b) != 0)
+        return false;
+    }
+
+  return true;
+}
+
+/* Returns the groups added, removed or modified from @old_kf to @new_kf */
+static GPtrArray *
+key_file_diff_groups (GKeyFile *old_kf,
+                      GKeyFile *new_kf)
+{
+  GPtrArray *res = g_ptr_array_new_null_terminated (8, g_free, true);
+  g_auto (GStrv) new_groups = g_key_file_get_groups (new_kf, NULL);
+
+  for (size_t i = 0; new_groups[i] != NULL; i++)
+    {
+      if (old_kf == NULL || !key_file_group_equal (old_kf, new_kf, new_groups[i]))
+        g_ptr_array_add (res, g_strdup (new_groups[i]));
+    }
+
+  if (old_kf != NULL)
+    {
+      g_auto (GStrv) old_groups = g_key_file_get_groups (old_kf, NULL);
+
+      for (size_t i = 0; old_groups[i] != NULL; i++)
+        {
+          if (!g_key_file_has_group (new_kf, old_groups[i]))
+            g_ptr_array_add (res, g_strdup (old_groups[i]));
+        }
+    }
+
+  return res;
+}
+
+/* Loads the effective file, and sets @changed_groups to the groups that
+ * changed since the last load, if any did */
+static bool
+config_file_load (ConfigFile *file,
+                  GPtrArray **changed_groups,
+                  GError **error)
+{
+  GStatBuf st;
+
+  file->loaded = true;
+
+  g_autofree char *path = config_source_find (file->source, file->basename, &st, &file->effective_index);
+
+  if (path == NULL)
+    {
+      g_clear_pointer (&file->path, g_free);
+      g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_NOT_FOUND,
+                   "No %s found in search dirs", file->basename);
+      return false;
+    }
+
+  gint64 mtime_nsec = (gint64) st.st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000) + st.st_mtim.tv_nsec;
+
+  if (g_strcmp0 (path, file->path) == 0 &&
+      st.st_dev == file->dev &&
+      st.st_ino == file->ino &&
+      st.st_size == file->size &&
+      mtime_nsec == file->mtime_nsec)
+    {
+      g_debug ("Skipping reload of unchanged %s", path);
+      file->n_skipped++;
+      return true;
+    }
+
+  g_autofree char *contents = NULL;
+  gsize length = 0;
+
+  if (!g_file_get_contents (path, &contents, &length, error))
+    return false;
+
+  g_autofree char *checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256, (const guchar *) contents, length);
+  bool same_contents = g_strcmp0 (checksum, file->checksum) == 0;
+
+  g_free (file->path);
+  file->path = g_steal_pointer (&path);
+  file->dev = st.st_dev;
+  file->ino = st.st_ino;
+  file->size = st.st_size;
+  file->mtime_nsec = mtime_nsec;
+  g_free (file->checksum);
+  file->checksum = g_steal_pointer (&checksum);
+
+  if (same_contents)
+    {
+      g_debug ("Skipping reload of %s with unchanged contents", file->path);
+      file->n_skipped++;
+      return true;
+    }
+
+  g_autoptr (GKeyFile) kf = g_key_file_new ();
+  if (!g_key_file_load_from_data (kf, contents, length, G_KEY_FILE_NONE, error))
+    return false;
+
+  g_debug ("Loading configuration from: %s", file->path);
+
+  g_autoptr (GPtrArray) changed = key_file_diff_groups (file->key_file, kf);
+
+  g_clear_pointer (&file->key_file, g_key_file_unref);
+  file->key_file = g_steal_pointer (&kf);
+  file->n_reloads++;
+
+  if (changed->len > 0)
+    *changed_groups = g_steal_pointer (&changed);
+
+  return true;
+}
+
+static bool
+config_file_reload (ConfigFile *file,
+                    bool notify,
+                    GError **error)
+{
+  g_autoptr (GPtrArray) changed_groups = NULL;
+
+  if (!config_file_load (file, &changed_groups, error))
+    return false;
+
+  if (changed_groups == NULL)
+    return true;
+
+  /* Subscribers may unsubscribe from their callback */
+  g_autoptr (GArray) subscribers = g_array_copy (file->subscribers);
+  for (guint i = 0; i < subscribers->len; i++)
+    {
+      const ConfigSubscriber *sub = &g_array_index (subscribers, ConfigSubscriber, i);
+
+      sub->func (file->key_file, (const char * const *) changed_groups->pdata, notify, sub->user_data);
+    }
+
+  return true;
+}
+
+static gboolean
+config_file__reload__timeout (gpointer user_data)
+{
+  ConfigFile *file = user_data;
+  g_autoptr (GError) error = NULL;
+
+  file->reload_id = 0;
+
+  if (!config_file_reload (file, true, &error))
+    g_debug ("Unable to reload %s: %s", file->basename, error->message);
+
+  g_debug ("%s: %u reloads, %u coalesced, %u skipped",
+           file->basename, file->n_reloads, file->n_coalesced, file->n_skipped);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+config_file_queue_reload (ConfigFile *file)
+{
+  if (file->reload_id != 0)
+    {
+      file->n_coalesced++;
+      return;
+    }
+
+  file->reload_id = g_timeout_add (reload_delay_ms, config_file__reload__timeout, file);
+}
+
+static void
+config_dir_file_changed (ConfigDir *dir,
+                         GFile *child,
+                         GFileMonitorEvent event_type,
+                         bool renamed_to)
+{
+  g_autofree char *name = g_file_get_basename (child);
+  ConfigFile *file = g_hash_table_lookup (dir->source->files, name);
+
+  /* Nobody is interested in this file */
+  if (file == NULL)
+    return;
+
+  switch (event_type)
+    {
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+      config_dir_set_file_presence (dir, file->basename, CONFIG_PRESENT);
+      break;
+
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+      config_dir_set_file_presence (dir, file->basename, CONFIG_MISSING);
+      break;
+
+    case G_FILE_MONITOR_EVENT_RENAMED:
+      /* Atomic saves rename a temporary file over the configuration file */
+      config_dir_set_file_presence (dir, file->basename, renamed_to ? CONFIG_PRESENT : CONFIG_MISSING);
+      break;
+
+    default:
+      /* Changes to a file shadowed by the effective one do not matter */
+      if (dir->index > file->effective_index)
+        return;
+      break;
+    }
+
+  config_file_queue_reload (file);
+}
+
+/* The directory itself appeared or disappeared, possibly with files in
+ * it, like after "cp -r", which no other event reports */
+static void
+config_dir_changed (ConfigDir *dir,
+                    ConfigPresence presence)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  dir->presence = presence;
+  g_hash_table_remove_all (dir->files);
+
+  g_hash_table_iter_init (&iter, dir->source->files);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    config_file_queue_reload (value);
+}
+
+static void
+config_dir__monitor__changed (GFileMonitor *monitor,
+                              GFile *file,
+                              GFile *other_file,
+                              GFileMonitorEvent event_type,
+                              gpointer user_data)
+{
+  ConfigDir *dir = user_data;
+
+  if (g_strcmp0 (g_file_peek_path (file), dir->path) == 0)
+    {
+      switch (event_type)
+        {
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_MOVED_IN:
+          config_dir_changed (dir, CONFIG_PRESENT);
+          break;
+
+        case G_FILE_MONITOR_EVENT_DELETED:
+        case G_FILE_MONITOR_EVENT_MOVED_OUT:
+          config_dir_changed (dir, CONFIG_MISSING);
+          break;
+
+        default:
+          break;
+        }
+
+      return;
+    }
+
+  /* Receiving events about its files means the directory exists (again) */
+  dir->presence = CONFIG_PRESENT;
+
+  config_dir_file_changed (dir, file, event_type, false);
+
+  if (event_type == G_FILE_MONITOR_EVENT_RENAMED && other_file != NULL)
+    config_dir_file_changed (dir, other_file, event_type, true);
+}
+
+static ConfigSource *
+config_source_new (void)
+{
+  ConfigSource *self = g_new0 (ConfigSource, 1);
+
+  self->dirs = g_ptr_array_new_with_free_func (config_dir_free);
+  self->files = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, config_file_free);
+
+  /* XDG_CONFIG_HOME/SteamOS/portal */
+  GPathBuf buf;
+  g_path_buf_init_from_path (&buf, g_get_user_config_dir ());
+  g_path_buf_push (&buf, "SteamOS");
+  g_path_buf_push (&buf, "portal");
+  g_ptr_array_add (self->dirs, config_dir_new (self, 0, g_path_buf_clear_to_path (&buf)));
+
+  /* XDG_CONFIG_DIRS/SteamOS/portal */
+  const char * const *system_dirs = g_get_system_config_dirs ();
+  for (size_t i = 0; system_dirs[i] != NULL; i++)
+    {
+      g_path_buf_init_from_path (&buf, system_dirs[i]);
+      g_path_buf_push (&buf, "SteamOS");
+      g_path_buf_push (&buf, "portal");
+      g_ptr_array_add (self->dirs, config_dir_new (self, self->dirs->len, g_path_buf_clear_to_path (&buf)));
+    }
+
+  return self;
+}
+
+ConfigSource *
+config_source_get_default (void)
+{
+  if (g_once_init_enter_pointer (&default_source))
+    g_once_init_leave_pointer (&default_source, config_source_new ());
+
+  return default_source;
+}
+
+char *
+config_source_lookup (ConfigSource *self,
+                      const char *basename,
+                      GStatBuf *st)
+{
+  guint index;
+
+  return config_source_find (self, basename, st, &index);
+}
+
+guint
+config_source_subscribe (ConfigSource *self,
+                         const char *basename,
+                         ConfigSourceFlags flags,
+                         ConfigSourceFunc func,
+                         gpointer user_data)
+{
+  ConfigFile *file = g_hash_table_lookup (self->files, basename);
+
+  if (file == NULL)
+    {
+      file = config_file_new (self, basename);
+      g_hash_table_insert (self->files, (gpointer) file->basename, file);
+    }
+
+  /* The subscribers that were already there either got the contents, or
+   * asked not to, so they are not told about this load */
+  if (!file->loaded && (flags & CONFIG_SOURCE_FLAGS_NO_INITIAL_LOAD) == 0)
+    {
+      g_autoptr (GPtrArray) changed_groups = NULL;
+      g_autoptr (GError) error = NULL;
+
+      if (!config_file_load (file, &changed_groups, &error))
+        g_debug ("Unable to read %s: %s", basename, error->message);
+    }
+
+  ConfigSubscriber sub = {
+    .id = ++self->last_subscription_id,
+    .func = func,
+    .user_data = user_data,
+  };
+  g_array_append_val (file->subscribers, sub);
+
+  /* Files shared by several subscribers are only loaded once, but each of
+   * them gets its own initial load */
+  if (file->key_file != NULL && (flags & CONFIG_SOURCE_FLAGS_NO_INITIAL_LOAD) == 0)
+    {
+      g_auto (GStrv) groups = g_key_file_get_groups (file->key_file, NULL);
+
+      func (file->key_file, (const char * const *) groups, false, user_data);
+    }
+
+  return sub.id;
+}
+
+typedef struct
+{
+  /* The effective file, if any, and the file to write */
+  char *source_path;
+  char *target_path;
+
+  GKeyFile *changes;
+} ConfigSaveData;
+
+static void
+config_save_data_free (gpointer data)
+{
+  ConfigSaveData *save = data;
+
+  g_free (save->source_path);
+  g_free (save->target_path);
+  g_key_file_unref (save->changes);
+  g_free (save);
+}
+
+static void
+key_file_merge (GKeyFile *key_file,
+                GKeyFile *changes)
+{
+  g_auto (GStrv) groups = g_key_file_get_groups (changes, NULL);
+
+  for (size_t i = 0; groups[i] != NULL; i++)
+    {
+      g_auto (GStrv) keys = g_key_file_get_keys (changes, groups[i], NULL, NULL);
+
+      for (size_t j = 0; keys != NULL && keys[j] != NULL; j++)
+        {
+          g_autofree char *value = g_key_file_get_value (changes, groups[i], keys[j], NULL);
+
+          g_key_file_set_value (key_file, groups[i], keys[j], value);
+        }
+    }
+}
+
+static void
+config_file_save_thread (GTask *task,
+                         gpointer source_object,
+                         gpointer task_data,
+                         GCancellable *cancellable)
+{
+  ConfigSaveData *save = task_data;
+  g_autoptr (GKeyFile) kf = g_key_file_new ();
+  g_autoptr (GError) error = NULL;
+
+  /* Start from the effective file, so that the keys that did not change
+   * are not lost when the user file starts shadowing a system one */
+  if (save->source_path != NULL &&
+      !g_key_file_load_from_file (kf, save->source_path,
+                                  G_KEY_FILE_KEEP_COMMENTS | G_KEY_FILE_KEEP_TRANSLATIONS,
+                                  &error) &&
+      !g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+    {
+      g_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
+
+  key_file_merge (kf, save->changes);
+
+  g_autofree char *dir = g_path_get_dirname (save->target_path);
+  if (g_mkdir_with_parents (dir, 0755) != 0)
+    {
+      int saved_errno = errno;
+
+      g_task_return_new_error (task, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                               "Unable to create %s: %s", dir, g_strerror (saved_errno));
+      return;
+    }
+
+  if (!g_key_file_save_to_file (kf, save->target_path, &error))
+    {
+      g_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void config_file_start_save (ConfigFile *file);
+
+static void
+config_file__save__done (GObject *source_object,
+                         GAsyncResult *result,
+                         gpointer user_data)
+{
+  ConfigFile *file = user_data;
+  g_autoptr (GError) error = NULL;
+
+  if (!g_task_propagate_boolean (G_TASK (result), &error))
+    g_warning ("Unable to save %s: %s", file->basename, error->message);
+
+  file->saving = false;
+
+  /* Changes made while saving */
+  if (file->pending_changes != NULL)
+    config_file_start_save (file);
+}
+
+static void
+config_file_start_save (ConfigFile *file)
+{
+  ConfigDir *user_dir = g_ptr_array_index (file->source->dirs, 0);
+  ConfigSaveData *save = g_new0 (ConfigSaveData, 1);
+  GStatBuf st;
+
+  save->source_path = config_source_lookup (file->source, file->basename, &st);
+  save->target_path = g_build_filename (user_dir->path, file->basename, NULL);
+  save->changes = g_steal_pointer (&file->pending_changes);
+
+  g_debug ("Saving %s", save->target_path);
+
+  g_autoptr (GTask) task = g_task_new (NULL, NULL, config_file__save__done, file);
+  g_task_set_source_tag (task, config_file_start_save);
+  g_task_set_task_data (task, save, config_save_data_free);
+  g_task_run_in_thread (task, config_file_save_thread);
+
+  file->saving = true;
+}
+
+void
+config_source_save (ConfigSource *self,
+                    const char *basename,
+                    GKeyFile *changes)
+{
+  ConfigFile *file = g_hash_table_lookup (self->files, basename);
+
+  g_return_if_fail (file != NULL);
+
+  if (file->pending_changes == NULL)
+    file->pending_changes = g_key_file_new ();
+
+  key_file_merge (file->pending_changes, changes);
+
+  if (!file->saving)
+    config_file_start_save (file);
+}
+
+void
+config_source_unsubscribe (ConfigSource *self,
+                           guint subscription_id)
+{
+  GHashTableIter iter;
+  ConfigFile *file;
+
+  g_hash_table_iter_init (&iter, self->files);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &file))
+    {
+      for (guint i = 0; i < file->subscribers->len; i++)
+        {
+          if (g_array_index (file->subscribers, ConfigSubscriber, i).id == subscription_id)
+            {
+              g_array_remove_index (file->subscribers, i);
+              return;
+            }
+        }
+    }
+}
@@ -0,0 +1,67 @@
+// config-source.h: Shared configuration loading and reloading
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <stdbool.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ConfigSource ConfigSource;
+
+typedef enum
+{
+  CONFIG_SOURCE_FLAGS_NONE = 0,
+
+  /* Only call the subscriber when the file is reloaded, e.g. because its
+   * current contents were obtained from elsewhere */
+  CONFIG_SOURCE_FLAGS_NO_INITIAL_LOAD = 1 << 0,
+} ConfigSourceFlags;
+
+/* Called with the parsed contents of a configuration file, which must not
+ * be modified, and the null-terminated list of groups that were added,
+ * removed or modified since the previous call; @notify is false for the
+ * initial load, and true for every reload */
+typedef void (* ConfigSourceFunc) (GKeyFile *key_file,
+                                   const char * const *changed_groups,
+                                   bool notify,
+                                   gpointer user_data);
+
+void
+config_source_set_reload_delay (guint delay_ms);
+
+ConfigSource *
+config_source_get_default (void);
+
+/* Returns the path of the effective @basename file, and fills @st, or
+ * returns NULL if there is none */
+char *
+config_source_lookup (ConfigSource *self,
+                      const char *basename,
+                      GStatBuf *st);
+
+guint
+config_source_subscribe (ConfigSource *self,
+                         const char *basename,
+                         ConfigSourceFlags flags,
+                         ConfigSourceFunc func,
+                         gpointer user_data);
+
+/* Writes the keys of @changes into @basename, in the user configuration
+ * directory, from a worker thread; the other keys of the effective file are
+ * preserved. Saves are serialized, and subscribers get notified through the
+ * usual reload once the file is written */
+void
+config_source_save (ConfigSource *self,
+                    const char *basename,
+                    GKeyFile *changes);
+
+void
+config_source_unsubscribe (ConfigSource *self,
+                           guint subscription_id);
+
+G_END_DECLS
@@ -0,0 +1,74 @@
+// dispatcher.c: Running the blocking parts of portal methods off the main thread
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "config.h"
+
+#include "dispatcher.h"
+
+/* Enough to launch a few helpers at once, without a burst of calls turning
+ * into a burst of threads */
+#define MAX_WORKERS 4
+
+typedef struct
+{
+  GTask *task;
+  GTaskThreadFunc func;
+} DispatchItem;
+
+static GThreadPool *workers;
+
+static void
+dispatcher_worker (gpointer data,
+                   gpointer user_data)
+{
+  DispatchItem *item = data;
+
+  /* Requests closed while waiting for a worker are not worth running */
+  if (!g_task_return_error_if_cancelled (item->task))
+    {
+      item->func (item->task,
+                  g_task_get_source_object (item->task),
+                  g_task_get_task_data (item->task),
+                  g_task_get_cancellable (item->task));
+    }
+
+  g_object_unref (item->task);
+  g_free (item);
+}
+
+static GThreadPool *
+dispatcher_get_workers (void)
+{
+  if (g_once_init_enter_pointer (&workers))
+    g_once_init_leave_pointer (&workers, g_thread_pool_new (dispatcher_worker, NULL, MAX_WORKERS, FALSE, NULL));
+
+  return workers;
+}
+
+GTask *
+dispatcher_task_new (gpointer source_object,
+                     Request *request,
+                     GDBusMethodInvocation *invocation,
+                     GAsyncReadyCallback callback,
+                     gpointer callback_data)
+{
+  /* The work outlives the method call, so Close must be able to reach it */
+  if (!request->exported)
+    request_export (request, g_dbus_method_invocation_get_connection (invocation));
+
+  return g_task_new (source_object, request->cancellable, callback, callback_data);
+}
+
+void
+dispatcher_run_task (GTask *task,
+                     GTaskThreadFunc func)
+{
+  DispatchItem *item = g_new0 (DispatchItem, 1);
+
+  item->task = g_object_ref (task);
+  item->func = func;
+
+  g_thread_pool_push (dispatcher_get_workers (), item, NULL);
+}
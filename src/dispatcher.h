@@ -0,0 +1,31 @@
+// dispatcher.h: Running the blocking parts of portal methods off the main thread
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "request.h"
+
+G_BEGIN_DECLS
+
+/* Returns a task doing the work of a method call on behalf of @request,
+ * which gets exported until it is released, so that Request.Close can
+ * cancel the task. @callback is called on the current thread-default main
+ * context, and is where the invocation should be completed */
+GTask *
+dispatcher_task_new (gpointer source_object,
+                     Request *request,
+                     GDBusMethodInvocation *invocation,
+                     GAsyncReadyCallback callback,
+                     gpointer callback_data);
+
+/* Runs @func on one of a bounded set of worker threads, unless the task
+ * was cancelled while it was queued */
+void
+dispatcher_run_task (GTask *task,
+                     GTaskThreadFunc func);
+
+G_END_DECLS
@@ -6,11 +6,133 @@
 #include "config.h"
 
 #include "email.h"
+#include "dispatcher.h"
+#include "rate-limit.h"
 #include "request.h"
+#include "uri-helper.h"
+#include "uri-router.h"
 
 #include "utils.h"
 #include "xdg-desktop-portal-dbus.h"
 
+typedef struct
+{
+  GDBusMethodInvocation *invocation;
+  Request *request;
+  UriHelper *helper;
+  char *url;
+} ComposeEmailData;
+
+static void
+compose_email_data_free (gpointer data)
+{
+  ComposeEmailData *compose = data;
+
+  g_clear_object (&compose->invocation);
+  g_clear_pointer (&compose->request, request_release);
+  g_clear_pointer (&compose->helper, uri_helper_unref);
+  g_free (compose->url);
+  g_free (compose);
+}
+
+static void
+complete_compose_email (XdpImplEmail *object,
+                        GDBusMethodInvocation *invocation,
+                        guint response)
+{
+  GVariantBuilder opt_builder;
+  g_variant_builder_init (&opt_builder, G_VARIANT_TYPE_VARDICT);
+  xdp_impl_email_complete_compose_email (object,
+                                         invocation,
+                                         response,
+                                         g_variant_builder_end (&opt_builder));
+}
+
+/* Launching forks and execs the helper, which can take a while, so it is
+ * kept off the main thread where it would delay every other call */
+static void
+compose_email_thread (GTask *task,
+                      gpointer source_object,
+                      gpointer task_data,
+                      GCancellable *cancellable)
+{
+  ComposeEmailData *compose = task_data;
+  g_autoptr(GError) error = NULL;
+
+  g_debug ("Launching %s with %s", compose->helper->app_id, compose->url);
+
+  if (!launch_command_spawn (compose->helper->command, compose->url, &error))
+    {
+      g_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+compose_email__launch_uris__done (GObject *source_object,
+                                  GAsyncResult *result,
+                                  gpointer user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(GError) error = NULL;
+
+  if (!g_app_info_launch_uris_finish (G_APP_INFO (source_object), result, &error))
+    g_task_return_error (task, g_steal_pointer (&error));
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+/* Helpers that LaunchCommand cannot spawn are launched through GIO, which
+ * is only meant to be used from the main thread */
+static void
+compose_email_launch_uris (GTask *task)
+{
+  ComposeEmailData *compose = g_task_get_task_data (task);
+  GAppInfo *info = compose->helper->info;
+  g_autoptr(GList) uris = NULL;
+
+  g_debug ("Launching %s with %s", g_app_info_get_display_name (info), compose->url);
+
+  uris = g_list_append (uris, compose->url);
+  g_app_info_launch_uris_async (info, uris, NULL, g_task_get_cancellable (task),
+                                compose_email__launch_uris__done, g_object_ref (task));
+}
+
+static void
+compose_email__launch__done (GObject *source_object,
+                             GAsyncResult *result,
+                             gpointer user_data)
+{
+  GTask *task = G_TASK (result);
+  ComposeEmailData *compose = g_task_get_task_data (task);
+  g_autoptr(GError) error = NULL;
+  guint response = 0;
+
+  if (!g_task_propagate_boolean (task, &error))
+    {
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          g_debug ("Request %s was closed before launching", compose->request->id);
+          response = 1;
+        }
+      else
+        {
+          response = 2;
+          g_warning ("Failed to launch %s: %s",
+                     g_app_info_get_display_name (compose->helper->info),
+                     error->message);
+        }
+    }
+
+  complete_compose_email (XDP_IMPL_EMAIL (source_object), g_steal_pointer (&compose->invocation), response);
+
+  /* Neither of these can be released from the launching thread */
+  g_clear_pointer (&compose->request, request_release);
+  g_clear_pointer (&compose->helper, uri_helper_unref);
+}
+
 static bool
 handle_compose_email (XdpImplEmail *object,
                       GDBusMethodInvocation *invocation,
@@ -20,52 +142,62 @@ handle_compose_email (XdpImplEmail *object,
                       GVariant *arg_options)
 {
   const char *sender = g_dbus_method_invocation_get_sender (invocation);
-  g_autoptr(Request) request = request_new (sender, arg_app_id, arg_handle);
-  g_object_ref (request);
 
-  guint response = 0;
-  g_autoptr(GAppInfo) info = get_steam_uri_helper ();
-  if (!info)
-    response = 2;
-  else
+  if (!rate_limiter_consume (rate_limiter_get_default (), arg_app_id))
     {
-      const char *address = NULL;
-      g_variant_lookup (arg_options, "address", "&s", &address);
-      const char * const *addresses = NULL;
-      g_variant_lookup (arg_options, "addresses", "^a&s", &addresses);
-      if (!address && addresses)
-        {
-          address = addresses[0];
-        }
+      g_dbus_method_invocation_return_error (invocation,
+                                             XDG_DESKTOP_PORTAL_ERROR,
+                                             XDG_DESKTOP_PORTAL_ERROR_NOT_ALLOWED,
+                                             "Too many requests");
+      return true;
+    }
 
-      // The portal API for e-mail allows passing additional addresses,
-      // CC and BCC fields, a subject, a body, and even attachments,
-      // but steam-http-loader only allows one address and discards all
-      // parameters when passed a mailto: URL, so there is no point in
-      // passing them through.
+  Request *request = request_acquire (sender, arg_app_id, arg_handle);
 
-      g_autoptr(GString) url = g_string_new (I_("mailto://"));
-      g_string_append_printf (url, "%s", address);
-      g_debug ("Launching %s with %s", g_app_info_get_display_name (info), url->str);
-      g_autoptr(GList) uris = NULL;
-      uris = g_list_append (uris, url->str);
+  const char *address = NULL;
+  g_variant_lookup (arg_options, "address", "&s", &address);
+  const char * const *addresses = NULL;
+  g_variant_lookup (arg_options, "addresses", "^a&s", &addresses);
+  if (!address && addresses)
+    {
+      address = addresses[0];
+    }
 
-      g_autoptr(GError) error = NULL;
-      if (!g_app_info_launch_uris (info, uris, NULL, &error)) {
-          response = 2;
-          g_warning ("Failed to launch %s: %s", g_app_info_get_display_name (info), error->message);
-          g_clear_error (&error);
-      }
+  // The portal API for e-mail allows passing additional addresses,
+  // CC and BCC fields, a subject, a body, and even attachments,
+  // but steam-http-loader only allows one address and discards all
+  // parameters when passed a mailto: URL, so there is no point in
+  // passing them through.
+
+  g_autoptr(GString) url = g_string_new (I_("mailto://"));
+  g_string_append_printf (url, "%s", address);
+
+  // routing.conf may send e-mail to another helper than Steam's
+  g_autoptr(UriHelper) helper = uri_router_lookup (uri_router_get_default (), url->str);
+  if (!helper)
+    helper = get_steam_uri_helper ();
+
+  if (!helper)
+    {
+      complete_compose_email (object, invocation, 2);
+      request_release (request);
+      return true;
     }
 
-  GVariantBuilder opt_builder;
-  g_variant_builder_init (&opt_builder, G_VARIANT_TYPE_VARDICT);
-  xdp_impl_email_complete_compose_email (object,
-                                         invocation,
-                                         response,
-                                         g_variant_builder_end (&opt_builder));
+  ComposeEmailData *compose = g_new0 (ComposeEmailData, 1);
+  compose->invocation = invocation;
+  compose->request = request;
+  compose->helper = g_steal_pointer (&helper);
+  compose->url = g_string_free (g_steal_pointer (&url), FALSE);
 
-  g_object_unref (request);
+  g_autoptr(GTask) task = dispatcher_task_new (object, request, invocation, compose_email__launch__done, NULL);
+  g_task_set_source_tag (task, handle_compose_email);
+  g_task_set_task_data (task, compose, compose_email_data_free);
+
+  if (compose->helper->command != NULL)
+    dispatcher_run_task (task, compose_email_thread);
+  else
+    compose_email_launch_uris (task);
 
   return true;
 }
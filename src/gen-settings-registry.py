@@ -0,0 +1,408 @@
+#!/usr/bin/env python3
+#
+# gen-settings-registry.py: Generate the Settings key registry
+#
+# SPDX-FileCopyrightText: 2025 Valve Corporation
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Usage: gen-settings-registry.py SCHEMA OUTPUT
+#
+# Reads the namespaces and keys declared in SCHEMA (see settings-schema.ini)
+# and writes a C source file implementing settings-registry.h, using two
+# perfect hash tables to look up namespaces and namespace/key pairs.
+
+import configparser
+import hashlib
+import sys
+
+FNV_OFFSET_BASIS = 0x811c9dc5
+FNV_PRIME = 0x01000193
+
+MAX_SEED = 1 << 20
+
+TYPE_STRINGS = {
+    'SETTING_INT_VALUE': 'i',
+    'SETTING_STRING_VALUE': 's',
+    'SETTING_COLOR_VALUE': '(ddd)',
+}
+
+
+def fnv1a(seed, *parts):
+    # Must match settings_registry_hash() in the generated code
+    h = FNV_OFFSET_BASIS ^ seed
+    for n, part in enumerate(parts):
+        if n > 0:
+            h = (h * FNV_PRIME) & 0xffffffff
+        for byte in part.encode('utf-8'):
+            h ^= byte
+            h = (h * FNV_PRIME) & 0xffffffff
+    return h
+
+
+def find_perfect_hash(keys):
+    size = 1
+    while size < len(keys):
+        size <<= 1
+
+    while True:
+        for seed in range(MAX_SEED):
+            slots = [-1] * size
+            for index, key in enumerate(keys):
+                slot = fnv1a(seed, *key) & (size - 1)
+                if slots[slot] != -1:
+                    break
+                slots[slot] = index
+            else:
+                return seed, slots
+        size <<= 1
+
+
+def c_string(value):
+    escaped = value.replace('\\', '\\\\').replace('"', '\\"')
+    return '"{}"'.format(escaped)
+
+
+def parse_default(namespace, key, value_type, args):
+    try:
+        if value_type == 'int':
+            if len(args) != 1:
+                raise ValueError('expected one integer')
+            return 'SETTING_INT_VALUE', '{{ .v_int = {} }}'.format(int(args[0]))
+
+        if value_type == 'string':
+            return 'SETTING_STRING_VALUE', '{{ .v_str = {} }}'.format(c_string(' '.join(args)))
+
+        if value_type == 'color':
+            if len(args) != 3:
+                raise ValueError('expected three doubles')
+            red, green, blue = (float(arg) for arg in args)
+            return 'SETTING_COLOR_VALUE', '{{ .v_color = {{ {!r}, {!r}, {!r} }} }}'.format(red, green, blue)
+    except ValueError as e:
+        sys.exit('{}/{}: invalid default value: {}'.format(namespace, key, e))
+
+    sys.exit('{}/{}: unknown type "{}"'.format(namespace, key, value_type))
+
+
+PREAMBLE = '''\
+// settings-registry.c: Generated by gen-settings-registry.py, do not edit
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "config.h"
+
+#include "settings-registry.h"
+
+#include <math.h>
+#include <string.h>
+
+static inline guint32
+settings_registry_hash (guint32 seed,
+                        const char *namespace,
+                        const char *key)
+{
+  guint32 h = 0x811c9dc5u ^ seed;
+
+  for (const unsigned char *p = (const unsigned char *) namespace; *p != '\\0'; p++)
+    {
+      h ^= *p;
+      h *= 0x01000193u;
+    }
+
+  if (key != NULL)
+    {
+      h *= 0x01000193u;
+
+      for (const unsigned char *p = (const unsigned char *) key; *p != '\\0'; p++)
+        {
+          h ^= *p;
+          h *= 0x01000193u;
+        }
+    }
+
+  return h;
+}
+'''
+
+TYPE_FUNCTIONS = {
+    'int': '''
+static void
+parse_int (const SettingInfo *info,
+           GKeyFile *key_file,
+           SettingData *data)
+{
+  g_autoptr (GError) error = NULL;
+
+  data->v_int = g_key_file_get_integer (key_file, info->namespace, info->key, &error);
+  if (error != NULL)
+    data->v_int = info->default_value.v_int;
+}
+
+static void
+save_int (const SettingInfo *info,
+          GKeyFile *key_file,
+          const SettingData *data)
+{
+  g_key_file_set_integer (key_file, info->namespace, info->key, data->v_int);
+}
+
+static GVariant *
+serialize_int (const SettingData *data)
+{
+  return g_variant_new_int32 (data->v_int);
+}
+
+static void
+deserialize_int (GVariant *variant,
+                 SettingData *data)
+{
+  data->v_int = g_variant_get_int32 (variant);
+}
+
+static gboolean
+equal_int (const SettingData *a,
+           const SettingData *b)
+{
+  return a->v_int == b->v_int;
+}
+''',
+    'string': '''
+static void
+parse_string (const SettingInfo *info,
+              GKeyFile *key_file,
+              SettingData *data)
+{
+  data->v_str = g_key_file_get_string (key_file, info->namespace, info->key, NULL);
+  if (data->v_str == NULL)
+    data->v_str = g_strdup (info->default_value.v_str);
+}
+
+static void
+save_string (const SettingInfo *info,
+             GKeyFile *key_file,
+             const SettingData *data)
+{
+  g_key_file_set_string (key_file, info->namespace, info->key, data->v_str);
+}
+
+static GVariant *
+serialize_string (const SettingData *data)
+{
+  return g_variant_new_string (data->v_str);
+}
+
+static void
+deserialize_string (GVariant *variant,
+                    SettingData *data)
+{
+  data->v_str = g_variant_dup_string (variant, NULL);
+}
+
+static gboolean
+equal_string (const SettingData *a,
+              const SettingData *b)
+{
+  return g_strcmp0 (a->v_str, b->v_str) == 0;
+}
+''',
+    'color': '''
+static void
+parse_color (const SettingInfo *info,
+             GKeyFile *key_file,
+             SettingData *data)
+{
+  gsize n_items = 0;
+  g_autofree double *colors = g_key_file_get_double_list (key_file, info->namespace, info->key, &n_items, NULL);
+
+  if (colors == NULL)
+    {
+      data->v_color = info->default_value.v_color;
+      return;
+    }
+
+  data->v_color.red = n_items > 0 ? colors[0] : 0.0;
+  data->v_color.green = n_items > 1 ? colors[1] : 0.0;
+  data->v_color.blue = n_items > 2 ? colors[2] : 0.0;
+}
+
+static void
+save_color (const SettingInfo *info,
+            GKeyFile *key_file,
+            const SettingData *data)
+{
+  double colors[] = {
+    data->v_color.red,
+    data->v_color.green,
+    data->v_color.blue,
+  };
+
+  g_key_file_set_double_list (key_file, info->namespace, info->key, colors, G_N_ELEMENTS (colors));
+}
+
+static GVariant *
+serialize_color (const SettingData *data)
+{
+  return g_variant_new ("(ddd)",
+                        data->v_color.red,
+                        data->v_color.green,
+                        data->v_color.blue);
+}
+
+static void
+deserialize_color (GVariant *variant,
+                   SettingData *data)
+{
+  g_variant_get (variant, "(ddd)",
+                 &data->v_color.red,
+                 &data->v_color.green,
+                 &data->v_color.blue);
+}
+
+static gboolean
+equal_color (const SettingData *a,
+             const SettingData *b)
+{
+  return fabs (a->v_color.red - b->v_color.red) < SETTING_COLOR_EPSILON &&
+         fabs (a->v_color.green - b->v_color.green) < SETTING_COLOR_EPSILON &&
+         fabs (a->v_color.blue - b->v_color.blue) < SETTING_COLOR_EPSILON;
+}
+''',
+}
+
+LOOKUP = '''
+size_t
+settings_registry_get_n_settings (void)
+{
+  return G_N_ELEMENTS (settings);
+}
+
+size_t
+settings_registry_get_n_namespaces (void)
+{
+  return G_N_ELEMENTS (namespaces);
+}
+
+const SettingNamespaceInfo *
+settings_registry_get_namespaces (void)
+{
+  return namespaces;
+}
+
+const SettingNamespaceInfo *
+settings_registry_lookup_namespace (const char *namespace)
+{
+  guint32 h = settings_registry_hash (NAMESPACES_SEED, namespace, NULL);
+  gint16 idx = namespaces_slots[h & (G_N_ELEMENTS (namespaces_slots) - 1)];
+
+  if (idx < 0 || strcmp (namespaces[idx].namespace, namespace) != 0)
+    return NULL;
+
+  return &namespaces[idx];
+}
+
+const SettingInfo *
+settings_registry_lookup (const char *namespace,
+                          const char *key)
+{
+  guint32 h = settings_registry_hash (SETTINGS_SEED, namespace, key);
+  gint16 idx = settings_slots[h & (G_N_ELEMENTS (settings_slots) - 1)];
+
+  if (idx < 0 ||
+      strcmp (settings[idx].namespace, namespace) != 0 ||
+      strcmp (settings[idx].key, key) != 0)
+    return NULL;
+
+  return &settings[idx];
+}
+'''
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.exit('Usage: {} SCHEMA OUTPUT'.format(argv[0]))
+
+    schema = configparser.ConfigParser(interpolation=None, comment_prefixes=('#',))
+    schema.optionxform = str
+    with open(argv[1], encoding='utf-8') as f:
+        schema.read_file(f)
+
+    namespaces = []
+    settings = []
+    # Sorted, so that users can binary search the namespaces table
+    for namespace in sorted(schema.sections()):
+        first = len(settings)
+        for key, declaration in schema.items(namespace):
+            value_type, *args = declaration.split()
+            settings.append((namespace, key) + parse_default(namespace, key, value_type, args))
+        namespaces.append((namespace, first, len(settings) - first))
+
+    if not settings:
+        sys.exit('{}: no settings declared'.format(argv[1]))
+
+    if len(settings) > 0x7fff:
+        sys.exit('{}: too many settings declared'.format(argv[1]))
+
+    ns_seed, ns_slots = find_perfect_hash([(ns,) for ns, _, _ in namespaces])
+    key_seed, key_slots = find_perfect_hash([(ns, key) for ns, key, _, _ in settings])
+
+    out = [PREAMBLE]
+
+    for value_type, functions in TYPE_FUNCTIONS.items():
+        if any(v[2] == 'SETTING_{}_VALUE'.format(value_type.upper()) for v in settings):
+            out.append(functions)
+
+    out.append('static const SettingInfo settings[] = {')
+    for index, (namespace, key, value_type, default) in enumerate(settings):
+        suffix = value_type[len('SETTING_'):-len('_VALUE')].lower()
+        out.append('  {')
+        out.append('    .index = {},'.format(index))
+        out.append('    .namespace = {},'.format(c_string(namespace)))
+        out.append('    .key = {},'.format(c_string(key)))
+        out.append('    .value_type = {},'.format(value_type))
+        out.append('    .type_string = {},'.format(c_string(TYPE_STRINGS[value_type])))
+        out.append('    .default_value = {},'.format(default))
+        out.append('    .parse = parse_{},'.format(suffix))
+        out.append('    .save = save_{},'.format(suffix))
+        out.append('    .serialize = serialize_{},'.format(suffix))
+        out.append('    .deserialize = deserialize_{},'.format(suffix))
+        out.append('    .equal = equal_{},'.format(suffix))
+        out.append('  },')
+    out.append('};')
+    out.append('')
+
+    out.append('static const SettingNamespaceInfo namespaces[] = {')
+    for index, (namespace, first, n_settings) in enumerate(namespaces):
+        out.append('  {')
+        out.append('    .index = {},'.format(index))
+        out.append('    .namespace = {},'.format(c_string(namespace)))
+        out.append('    .settings = &settings[{}],'.format(first))
+        out.append('    .n_settings = {},'.format(n_settings))
+        out.append('  },')
+    out.append('};')
+    out.append('')
+
+    out.append('#define NAMESPACES_SEED {:#x}u'.format(ns_seed))
+    out.append('static const gint16 namespaces_slots[] = {{ {} }};'.format(', '.join(str(s) for s in ns_slots)))
+    out.append('')
+    out.append('#define SETTINGS_SEED {:#x}u'.format(key_seed))
+    out.append('static const gint16 settings_slots[] = {{ {} }};'.format(', '.join(str(s) for s in key_slots)))
+
+    checksum = hashlib.sha256()
+    for namespace, key, value_type, default in settings:
+        checksum.update('{}\0{}\0{}\0{}\n'.format(namespace, key, value_type, default).encode('utf-8'))
+
+    out.append('')
+    out.append('const char *')
+    out.append('settings_registry_get_checksum (void)')
+    out.append('{')
+    out.append('  return {};'.format(c_string(checksum.hexdigest())))
+    out.append('}')
+
+    out.append(LOOKUP)
+
+    with open(argv[2], 'w', encoding='utf-8') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,364 @@
+// launcher.c: Spawning of URI helpers
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "config.h"
+
+#include "launcher.h"
+
+#include <errno.h>
+#include <gio/gdesktopappinfo.h>
+#include <glib-unix.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct _LaunchCommand
+{
+  /* Desktop ID, for logging */
+  char *name;
+
+  /* Null-terminated, starting with an absolute path */
+  char **argv;
+  int argc;
+
+  /* Index of the argument standing for the URI, or -1 if the application
+   * does not take any */
+  int uri_index;
+
+  char **envp;
+
+  GMutex lock;
+  guint n_launches;
+  gint64 total_usec;
+  gint64 max_usec;
+};
+
+typedef struct
+{
+  GPid pid;
+  int pidfd;
+  char *name;
+} LaunchedChild;
+
+/* Field codes from the desktop entry specification that stand for the
+ * whole argument */
+static bool
+expand_field_code (GDesktopAppInfo *info,
+                   const char *arg,
+                   GPtrArray *argv,
+                   int *uri_index,
+                   bool *handled)
+{
+  *handled = true;
+
+  if (g_str_equal (arg, "%u") || g_str_equal (arg, "%U"))
+    {
+      /* Only one URI is ever passed */
+      if (*uri_index < 0)
+        {
+          *uri_index = argv->len;
+          g_ptr_array_add (argv, g_strdup (""));
+        }
+    }
+  else if (g_str_equal (arg, "%i"))
+    {
+      g_autofree char *icon = g_desktop_app_info_get_string (info, G_KEY_FILE_DESKTOP_KEY_ICON);
+
+      if (icon != NULL)
+        {
+          g_ptr_array_add (argv, g_strdup ("--icon"));
+          g_ptr_array_add (argv, g_steal_pointer (&icon));
+        }
+    }
+  else if (g_str_equal (arg, "%c"))
+    {
+      g_ptr_array_add (argv, g_strdup (g_app_info_get_name (G_APP_INFO (info))));
+    }
+  else if (g_str_equal (arg, "%k"))
+    {
+      const char *filename = g_desktop_app_info_get_filename (info);
+
+      if (filename != NULL)
+        g_ptr_array_add (argv, g_strdup (filename));
+    }
+  else if (g_str_equal (arg, "%f") || g_str_equal (arg, "%F"))
+    {
+      /* These need a local path, which URIs do not have in general */
+      return false;
+    }
+  else if (strlen (arg) == 2 && arg[0] == '%' && strchr ("dDnNvm", arg[1]) != NULL)
+    {
+      /* Deprecated, and expanding to nothing */
+    }
+  else
+    {
+      *handled = false;
+    }
+
+  return true;
+}
+
+/* Only unescapes "%%", since field codes embedded in arguments are not
+ * supported */
+static char *
+unescape_arg (const char *arg)
+{
+  g_autoptr (GString) res = g_string_sized_new (strlen (arg));
+
+  for (const char *p = arg; *p != '\0'; p++)
+    {
+      if (*p == '%')
+        {
+          if (p[1] != '%')
+            return NULL;
+          p++;
+        }
+
+      g_string_append_c (res, *p);
+    }
+
+  return g_string_free (g_steal_pointer (&res), FALSE);
+}
+
+LaunchCommand *
+launch_command_new (GAppInfo *app_info)
+{
+  if (!G_IS_DESKTOP_APP_INFO (app_info))
+    return NULL;
+
+  GDesktopAppInfo *info = G_DESKTOP_APP_INFO (app_info);
+  const char *id = g_app_info_get_id (app_info);
+
+  if (g_desktop_app_info_get_boolean (info, "DBusActivatable") ||
+      g_desktop_app_info_get_boolean (info, G_KEY_FILE_DESKTOP_KEY_TERMINAL) ||
+      g_desktop_app_info_has_key (info, G_KEY_FILE_DESKTOP_KEY_PATH))
+    {
+      g_debug ("%s needs to be launched through GIO", id);
+      return NULL;
+    }
+
+  g_auto (GStrv) args = NULL;
+  g_autoptr (GError) error = NULL;
+
+  if (!g_shell_parse_argv (g_app_info_get_commandline (app_info), NULL, &args, &error))
+    {
+      g_debug ("Unable to parse the command line of %s: %s", id, error->message);
+      return NULL;
+    }
+
+  g_autoptr (GPtrArray) argv = g_ptr_array_new_null_terminated (8, g_free, TRUE);
+  int uri_index = -1;
+
+  for (size_t i = 0; args[i] != NULL; i++)
+    {
+      bool handled;
+
+      if (!expand_field_code (info, args[i], argv, &uri_index, &handled))
+        {
+          g_debug ("%s needs to be launched through GIO", id);
+          return NULL;
+        }
+
+      if (handled)
+        continue;
+
+      char *arg = unescape_arg (args[i]);
+      if (arg == NULL)
+        {
+          g_debug ("Unsupported argument %s in the command line of %s", args[i], id);
+          return NULL;
+        }
+
+      g_ptr_array_add (argv, arg);
+    }
+
+  if (argv->len == 0 || uri_index == 0)
+    return NULL;
+
+  /* Resolved once, so that spawning does not search PATH */
+  char *path = g_find_program_in_path (g_ptr_array_index (argv, 0));
+  if (path == NULL)
+    {
+      g_debug ("Unable to find %s for %s", (const char *) g_ptr_array_index (argv, 0), id);
+      return NULL;
+    }
+
+  g_free (g_ptr_array_index (argv, 0));
+  argv->pdata[0] = path;
+
+  LaunchCommand *command = g_new0 (LaunchCommand, 1);
+
+  command->name = g_strdup (id);
+  command->argc = argv->len;
+  command->argv = (char **) g_ptr_array_free (g_steal_pointer (&argv), FALSE);
+  command->uri_index = uri_index;
+  command->envp = g_get_environ ();
+  g_mutex_init (&command->lock);
+
+  const char *filename = g_desktop_app_info_get_filename (info);
+  if (filename != NULL)
+    command->envp = g_environ_setenv (command->envp, "GIO_LAUNCHED_DESKTOP_FILE", filename, TRUE);
+
+  return command;
+}
+
+void
+launch_command_free (LaunchCommand *command)
+{
+  if (command != NULL)
+    {
+      g_mutex_clear (&command->lock);
+      g_strfreev (command->argv);
+      g_strfreev (command->envp);
+      g_free (command->name);
+      g_free (command);
+    }
+}
+
+static void
+launched_child_free (gpointer data)
+{
+  LaunchedChild *child = data;
+
+  if (child->pidfd >= 0)
+    close (child->pidfd);
+
+  g_free (child->name);
+  g_free (child);
+}
+
+static void
+launched_child_exited (LaunchedChild *child,
+                       int wait_status)
+{
+  g_autoptr (GError) error = NULL;
+
+  if (!g_spawn_check_wait_status (wait_status, &error))
+    g_debug ("%s (%d) failed: %s", child->name, child->pid, error->message);
+  else
+    g_debug ("%s (%d) exited", child->name, child->pid);
+}
+
+static gboolean
+launched_child__pidfd__ready (int fd,
+                              GIOCondition condition,
+                              gpointer user_data)
+{
+  LaunchedChild *child = user_data;
+  int wait_status = 0;
+  pid_t res;
+
+  do
+    res = waitpid (child->pid, &wait_status, WNOHANG);
+  while (res < 0 && errno == EINTR);
+
+  if (res == 0)
+    return G_SOURCE_CONTINUE;
+
+  if (res > 0)
+    launched_child_exited (child, wait_status);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+launched_child__watch__exited (GPid pid,
+                               int wait_status,
+                               gpointer user_data)
+{
+  launched_child_exited (user_data, wait_status);
+}
+
+static int
+open_pidfd (pid_t pid)
+{
+#ifdef SYS_pidfd_open
+  return syscall (SYS_pidfd_open, pid, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+/* The sources are attached to the default main context, which also works
+ * from other threads */
+static void
+launched_child_watch (GPid pid,
+                      const char *name)
+{
+  LaunchedChild *child = g_new0 (LaunchedChild, 1);
+
+  child->pid = pid;
+  child->name = g_strdup (name);
+  child->pidfd = open_pidfd (pid);
+
+  if (child->pidfd >= 0)
+    {
+      g_unix_fd_add_full (G_PRIORITY_DEFAULT, child->pidfd, G_IO_IN,
+                          launched_child__pidfd__ready, child, launched_child_free);
+    }
+  else
+    {
+      /* Kernels older than 5.3 */
+      g_child_watch_add_full (G_PRIORITY_DEFAULT, pid,
+                              launched_child__watch__exited, child, launched_child_free);
+    }
+}
+
+bool
+launch_command_spawn (LaunchCommand *command,
+                      const char *uri,
+                      GError **error)
+{
+  g_autofree char **argv = g_memdup2 (command->argv, sizeof (char *) * (command->argc + 1));
+
+  if (command->uri_index >= 0)
+    argv[command->uri_index] = (char *) uri;
+
+  /* Signals ignored or blocked by this process, like SIGPIPE, must not be
+   * inherited by the child */
+  posix_spawnattr_t attr;
+  sigset_t mask;
+
+  posix_spawnattr_init (&attr);
+  sigemptyset (&mask);
+  posix_spawnattr_setsigmask (&attr, &mask);
+  sigfillset (&mask);
+  sigdelset (&mask, SIGKILL);
+  sigdelset (&mask, SIGSTOP);
+  posix_spawnattr_setsigdefault (&attr, &mask);
+  posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+  gint64 start = g_get_monotonic_time ();
+  pid_t pid;
+  int res = posix_spawn (&pid, argv[0], NULL, &attr, argv, command->envp);
+  gint64 latency = g_get_monotonic_time () - start;
+
+  posix_spawnattr_destroy (&attr);
+
+  if (res != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (res),
+                   "Unable to spawn %s: %s", argv[0], g_strerror (res));
+      return false;
+    }
+
+  g_mutex_lock (&command->lock);
+  command->n_launches++;
+  command->total_usec += latency;
+  command->max_usec = MAX (command->max_usec, latency);
+  g_debug ("Spawned %s (%d) in %" G_GINT64_FORMAT " µs; %u launches, mean %" G_GINT64_FORMAT
+           " µs, max %" G_GINT64_FORMAT " µs",
+           command->name, pid, latency,
+           command->n_launches, command->total_usec / command->n_launches, command->max_usec);
+  g_mutex_unlock (&command->lock);
+
+  launched_child_watch (pid, command->name);
+
+  return true;
+}
@@ -0,0 +1,35 @@
+// launcher.h: Spawning of URI helpers
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#pragma once
+
+#include <gio/gio.h>
+#include <stdbool.h>
+
+G_BEGIN_DECLS
+
+/* The command line and environment of an application, built once from its
+ * desktop file */
+typedef struct _LaunchCommand LaunchCommand;
+
+/* Returns NULL if the desktop file of @info needs features that only
+ * g_app_info_launch_uris() provides, such as D-Bus activation, a terminal
+ * or a working directory */
+LaunchCommand *
+launch_command_new (GAppInfo *info);
+
+void
+launch_command_free (LaunchCommand *command);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (LaunchCommand, launch_command_free)
+
+/* Spawns @command with @uri, without forking this process, and reaps the
+ * child from the default main context. May be called from any thread */
+bool
+launch_command_spawn (LaunchCommand *command,
+                      const char *uri,
+                      GError **error);
+
+G_END_DECLS
@@ -7,168 +7,208 @@
 
 #include "lockdown.h"
 
+#include "config-db.h"
+#include "config-source.h"
+
+#include "holo-dbus.h"
 #include "utils.h"
 #include "xdg-desktop-portal-dbus.h"
 
-#include <string.h>
-
 #define LOCKDOWN_GROUP  "Lockdown"
 #define PRIVACY_GROUP   "Privacy"
 
-#define LOCKDOWN_PRINTING_KEY                   "Printing"
-#define LOCKDOWN_SAVE_TO_DISK_KEY               "SaveToDisk"
-#define LOCKDOWN_APPLICATION_HANDLERS_KEY       "ApplicationHandlers"
-#define LOCKDOWN_LOCATION_KEY                   "Location"
-#define PRIVACY_CAMERA_KEY                      "Camera"
-#define PRIVACY_MICROPHONE_KEY                  "Microphone"
-#define PRIVACY_SOUND_OUTPUT_KEY                "SoundOutput"
-
 G_DECLARE_FINAL_TYPE (LockdownManager, lockdown_manager, LOCKDOWN, MANAGER, GObject)
 
+enum
+{
+  PROP_PRINTING = 1,
+  PROP_SAVE_TO_DISK,
+  PROP_APPLICATION_HANDLERS,
+  PROP_LOCATION,
+  PROP_CAMERA,
+  PROP_MICROPHONE,
+  PROP_SOUND_OUTPUT,
+
+  N_PROPS
+};
+
+typedef struct
+{
+  /* Group and key in lockdown.conf */
+  const char *group;
+  const char *key;
+
+  /* LockdownManager property, and the XdpImplLockdown property it is
+   * bound to, with an inverted value */
+  const char *property;
+  const char *dbus_property;
+
+  gboolean default_value;
+} LockdownKeyInfo;
+
+/* Indexed by property ID */
+static const LockdownKeyInfo lockdown_keys[N_PROPS] = {
+  [PROP_PRINTING] = { LOCKDOWN_GROUP, "Printing", "printing", "disable-printing", TRUE },
+  [PROP_SAVE_TO_DISK] = { LOCKDOWN_GROUP, "SaveToDisk", "save-to-disk", "disable-save-to-disk", TRUE },
+  [PROP_APPLICATION_HANDLERS] = { LOCKDOWN_GROUP, "ApplicationHandlers", "application-handlers", "disable-application-handlers", TRUE },
+  [PROP_LOCATION] = { LOCKDOWN_GROUP, "Location", "location", "disable-location", TRUE },
+  [PROP_CAMERA] = { PRIVACY_GROUP, "Camera", "camera", "disable-camera", TRUE },
+  [PROP_MICROPHONE] = { PRIVACY_GROUP, "Microphone", "microphone", "disable-microphone", TRUE },
+  [PROP_SOUND_OUTPUT] = { PRIVACY_GROUP, "SoundOutput", "sound-output", "disable-sound-output", TRUE },
+};
+
+G_STATIC_ASSERT (N_PROPS <= 32);
+
+#define LOCKDOWN_KEY_BIT(prop_id) (1u << (prop_id))
+#define LOCKDOWN_ALL_KEYS (((1u << N_PROPS) - 1) & ~1u)
+
 struct _LockdownManager
 {
   GObject parent_instance;
 
-  /* HashTable<unowned str, int> */
-  GHashTable *keys;
+  GDBusInterfaceSkeleton *helper;
+  GDBusInterfaceSkeleton *private_helper;
+
+  /* Bitmask of LOCKDOWN_KEY_BIT (prop_id) */
+  guint32 state;
 
-  GFileMonitor *file_monitor;
+  bool loaded;
+  guint config_id;
 };
 
-static LockdownManager *manager;
+static GParamSpec *obj_props[N_PROPS];
 
-static inline void
-lockdown_manager_set_key (LockdownManager *self,
-                          const char *key,
-                          gboolean value)
-{
-  g_hash_table_insert (self->keys, (gpointer) key, GINT_TO_POINTER (value));
-}
+static LockdownManager *manager;
 
 static inline gboolean
 lockdown_manager_get_key (LockdownManager *self,
-                          const char *key)
+                          guint prop_id)
 {
-  gpointer res = g_hash_table_lookup (self->keys, key);
-
-  return GPOINTER_TO_INT (res);
+  return (self->state & LOCKDOWN_KEY_BIT (prop_id)) != 0;
 }
 
-static bool load_lockdown_config (LockdownManager *lockdown_manager,
-                                  bool notify);
-
+/* Replaces the whole state, and only notifies the properties whose value
+ * changes */
 static void
-lockdown_manager__file_monitor__changed (GFileMonitor *monitor,
-                                         GFile *file,
-                                         GFile *other_file,
-                                         gpointer user_data)
+lockdown_manager_set_state (LockdownManager *self,
+                            guint32 state)
 {
-  load_lockdown_config (user_data, true);
-}
+  guint32 changed = self->state ^ state;
 
-static bool
-load_lockdown_config (LockdownManager *lockdown_manager,
-                      bool notify)
-{
-  g_autoptr (GPtrArray) search_dirs = g_ptr_array_new_null_terminated (8, g_free, true);
-
-  /* XDG_CONFIG_HOME/SteamOS/portal/lockdown.conf */
-  GPathBuf buf;
-  g_path_buf_init_from_path (&buf, g_get_user_config_dir ());
-  g_path_buf_push (&buf, "SteamOS");
-  g_path_buf_push (&buf, "portal");
-  char *path = g_path_buf_clear_to_path (&buf);
-  g_ptr_array_add (search_dirs, path);
-
-  /* XDG_CONFIG_DIRS/SteamOS/portal/lockdown.conf */
-  const char * const *system_dirs = g_get_system_config_dirs ();
-  for (size_t i = 0; system_dirs[i] != NULL; i++)
-    {
-      g_path_buf_init_from_path (&buf, system_dirs[i]);
-      g_path_buf_push (&buf, "SteamOS");
-      g_path_buf_push (&buf, "portal");
-      char *path = g_path_buf_clear_to_path (&buf);
+  self->state = state;
 
-      g_ptr_array_add (search_dirs, path);
-    }
+  if (changed == 0)
+    return;
 
-  g_autoptr (GKeyFile) kf = g_key_file_new ();
-  g_autofree char *full_path = NULL;
-  g_autoptr (GError) error = NULL;
+  /* Coalesce the changes into a single PropertiesChanged signal, that only
+   * lists the keys whose value changed */
+  if (self->helper != NULL)
+    g_object_freeze_notify (G_OBJECT (self->helper));
+  g_object_freeze_notify (G_OBJECT (self));
 
-  if (!g_key_file_load_from_dirs (kf, "lockdown.conf", (const char **) search_dirs->pdata, &full_path, G_KEY_FILE_NONE, &error))
+  for (guint prop_id = 1; prop_id < N_PROPS; prop_id++)
     {
-      g_debug ("Unable to read lockdown.conf: %s", error->message);
-      return false;
+      if (changed & LOCKDOWN_KEY_BIT (prop_id))
+        g_object_notify_by_pspec (G_OBJECT (self), obj_props[prop_id]);
     }
 
-  g_debug ("Loading lockdown configuration from: %s", full_path);
-
-  gboolean printing = !g_key_file_get_boolean (kf, LOCKDOWN_GROUP, LOCKDOWN_PRINTING_KEY, NULL);
-  gboolean save_to_disk = !g_key_file_get_boolean (kf, LOCKDOWN_GROUP, LOCKDOWN_SAVE_TO_DISK_KEY, NULL);
-  gboolean app_handlers = !g_key_file_get_boolean (kf, LOCKDOWN_GROUP, LOCKDOWN_APPLICATION_HANDLERS_KEY, NULL);
-  gboolean location = !g_key_file_get_boolean (kf, LOCKDOWN_GROUP, LOCKDOWN_LOCATION_KEY, NULL);
-  gboolean camera = !g_key_file_get_boolean (kf, PRIVACY_GROUP, PRIVACY_CAMERA_KEY, NULL);
-  gboolean microphone = !g_key_file_get_boolean (kf, PRIVACY_GROUP, PRIVACY_MICROPHONE_KEY, NULL);
-  gboolean sound_output = !g_key_file_get_boolean (kf, PRIVACY_GROUP, PRIVACY_SOUND_OUTPUT_KEY, NULL);
-
-  if (notify)
-    {
-      g_object_set (lockdown_manager,
-                    "printing", printing,
-                    "save-to-disk", save_to_disk,
-                    "application-handlers", app_handlers,
-                    "location", location,
-                    "camera", camera,
-                    "microphone", microphone,
-                    "sound-output", sound_output,
-                    NULL);
-    }
-  else
+  g_object_thaw_notify (G_OBJECT (self));
+  if (self->helper != NULL)
     {
-      lockdown_manager_set_key (lockdown_manager, I_("printing"), printing);
-      lockdown_manager_set_key (lockdown_manager, I_("save-to-disk"), save_to_disk);
-      lockdown_manager_set_key (lockdown_manager, I_("application-handlers"), app_handlers);
-      lockdown_manager_set_key (lockdown_manager, I_("location"), location);
-      lockdown_manager_set_key (lockdown_manager, I_("camera"), camera);
-      lockdown_manager_set_key (lockdown_manager, I_("microphone"), microphone);
-      lockdown_manager_set_key (lockdown_manager, I_("sound-output"), sound_output);
+      g_object_thaw_notify (G_OBJECT (self->helper));
+      g_dbus_interface_skeleton_flush (self->helper);
     }
+}
+
+/* The lockdown configuration, either parsed from lockdown.conf or read from
+ * the configuration image */
+typedef struct
+{
+  GKeyFile *key_file;
+  GVariant *db; /* a{sa{sb}} */
+} LockdownConfig;
+
+static gboolean
+lockdown_config_get_boolean (const LockdownConfig *config,
+                             const char *group,
+                             const char *key)
+{
+  gboolean value = FALSE;
+
+  if (config->key_file != NULL)
+    return g_key_file_get_boolean (config->key_file, group, key, NULL);
+
+  g_autoptr (GVariant) dict = g_variant_lookup_value (config->db, group, G_VARIANT_TYPE ("a{sb}"));
+  if (dict != NULL)
+    g_variant_lookup (dict, key, "b", &value);
+
+  return value;
+}
+
+static void
+apply_lockdown_config (LockdownManager *lockdown_manager,
+                       const LockdownConfig *config)
+{
+  guint32 state = 0;
 
-  if (lockdown_manager->file_monitor == NULL)
+  for (guint prop_id = 1; prop_id < N_PROPS; prop_id++)
     {
-      g_autoptr (GFile) file = g_file_new_for_path (full_path);
-      lockdown_manager->file_monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, &error);
-      if (error != NULL)
-        g_debug ("Unable to monitor lockdown.conf: %s", error->message);
+      const LockdownKeyInfo *info = &lockdown_keys[prop_id];
 
-      g_signal_connect (lockdown_manager->file_monitor, "changed", G_CALLBACK (lockdown_manager__file_monitor__changed), lockdown_manager);
+      if (!lockdown_config_get_boolean (config, info->group, info->key))
+        state |= LOCKDOWN_KEY_BIT (prop_id);
     }
 
-  return true;
+  lockdown_manager_set_state (lockdown_manager, state);
 }
 
-G_DEFINE_TYPE (LockdownManager, lockdown_manager, G_TYPE_OBJECT)
-
-enum
+static void
+load_lockdown_config (GKeyFile *kf,
+                      const char * const *changed_groups,
+                      bool notify,
+                      gpointer user_data)
 {
-  PROP_PRINTING = 1,
-  PROP_SAVE_TO_DISK,
-  PROP_APPLICATION_HANDLERS,
-  PROP_LOCATION,
-  PROP_CAMERA,
-  PROP_MICROPHONE,
-  PROP_SOUND_OUTPUT,
+  LockdownManager *lockdown_manager = user_data;
+  LockdownConfig config = { .key_file = kf };
 
-  N_PROPS
-};
+  if (notify &&
+      !g_strv_contains (changed_groups, LOCKDOWN_GROUP) &&
+      !g_strv_contains (changed_groups, PRIVACY_GROUP))
+    return;
 
-static GParamSpec *obj_props[N_PROPS];
+  apply_lockdown_config (lockdown_manager, &config);
+}
+
+G_DEFINE_TYPE (LockdownManager, lockdown_manager, G_TYPE_OBJECT)
 
+/* The configuration is only loaded once the name is acquired, or by the
+ * first call needing it, so that it does not delay the portal's startup;
+ * the skeleton is exported by then, so the loaded state gets announced */
 static void
-lockdown_manager_constructed (GObject *gobject)
+lockdown_manager_ensure_loaded (LockdownManager *self)
 {
-  load_lockdown_config ((LockdownManager *) gobject, false);
+  if (self->loaded)
+    return;
+
+  self->loaded = true;
+
+  ConfigSourceFlags flags = CONFIG_SOURCE_FLAGS_NONE;
+  GVariant *db = config_db_get_default ();
+
+  if (db != NULL)
+    {
+      g_autoptr (GVariant) lockdown = g_variant_get_child_value (db, CONFIG_DB_LOCKDOWN_INDEX);
+      LockdownConfig config = { .db = lockdown };
+
+      apply_lockdown_config (self, &config);
+      flags |= CONFIG_SOURCE_FLAGS_NO_INITIAL_LOAD;
+    }
+
+  self->config_id = config_source_subscribe (config_source_get_default (),
+                                             "lockdown.conf",
+                                             flags,
+                                             load_lockdown_config,
+                                             self);
 }
 
 static void
@@ -177,7 +217,13 @@ lockdown_manager_set_property (GObject *gobject,
                                const GValue *value,
                                GParamSpec *pspec)
 {
-  lockdown_manager_set_key ((LockdownManager *) gobject, pspec->name, g_value_get_boolean (value));
+  LockdownManager *self = LOCKDOWN_MANAGER (gobject);
+  guint32 state = self->state & ~LOCKDOWN_KEY_BIT (prop_id);
+
+  if (g_value_get_boolean (value))
+    state |= LOCKDOWN_KEY_BIT (prop_id);
+
+  lockdown_manager_set_state (self, state);
 }
 
 static void
@@ -186,7 +232,7 @@ lockdown_manager_get_property (GObject *gobject,
                                GValue *value,
                                GParamSpec *pspec)
 {
-  g_value_set_boolean (value, lockdown_manager_get_key ((LockdownManager *) gobject, pspec->name));
+  g_value_set_boolean (value, lockdown_manager_get_key ((LockdownManager *) gobject, prop_id));
 }
 
 static void
@@ -194,8 +240,8 @@ lockdown_manager_finalize (GObject *gobject)
 {
   LockdownManager *self = LOCKDOWN_MANAGER (gobject);
 
-  g_clear_object (&self->file_monitor);
-  g_clear_pointer (&self->keys, g_hash_table_unref);
+  if (self->config_id != 0)
+    config_source_unsubscribe (config_source_get_default (), self->config_id);
 
   G_OBJECT_CLASS (lockdown_manager_parent_class)->finalize (gobject);
 }
@@ -205,25 +251,107 @@ lockdown_manager_class_init (LockdownManagerClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 
-  gobject_class->constructed = lockdown_manager_constructed;
   gobject_class->set_property = lockdown_manager_set_property;
   gobject_class->get_property = lockdown_manager_get_property;
   gobject_class->finalize = lockdown_manager_finalize;
 
-  obj_props[PROP_PRINTING] = g_param_spec_boolean (I_("printing"), NULL, NULL, TRUE, G_PARAM_READWRITE | G_PARAM_STATIC_NAME);
-  obj_props[PROP_SAVE_TO_DISK] = g_param_spec_boolean (I_("save-to-disk"), NULL, NULL, TRUE, G_PARAM_READWRITE | G_PARAM_STATIC_NAME);
-  obj_props[PROP_APPLICATION_HANDLERS] = g_param_spec_boolean (I_("application-handlers"), NULL, NULL, TRUE, G_PARAM_READWRITE | G_PARAM_STATIC_NAME);
-  obj_props[PROP_LOCATION] = g_param_spec_boolean (I_("location"), NULL, NULL, TRUE, G_PARAM_READWRITE | G_PARAM_STATIC_NAME);
-  obj_props[PROP_CAMERA] = g_param_spec_boolean (I_("camera"), NULL, NULL, TRUE, G_PARAM_READWRITE | G_PARAM_STATIC_NAME);
-  obj_props[PROP_MICROPHONE] = g_param_spec_boolean (I_("microphone"), NULL, NULL, TRUE, G_PARAM_READWRITE | G_PARAM_STATIC_NAME);
-  obj_props[PROP_SOUND_OUTPUT] = g_param_spec_boolean (I_("sound-output"), NULL, NULL, TRUE, G_PARAM_READWRITE | G_PARAM_STATIC_NAME);
+  for (guint prop_id = 1; prop_id < N_PROPS; prop_id++)
+    {
+      obj_props[prop_id] = g_param_spec_boolean (lockdown_keys[prop_id].property, NULL, NULL,
+                                                 lockdown_keys[prop_id].default_value,
+                                                 G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+    }
+
   g_object_class_install_properties (gobject_class, N_PROPS, obj_props);
 }
 
 static void
 lockdown_manager_init (LockdownManager *self)
 {
-  self->keys = g_hash_table_new (g_str_hash, g_str_equal);
+  /* Without any configuration, the defaults apply */
+  for (guint prop_id = 1; prop_id < N_PROPS; prop_id++)
+    {
+      if (lockdown_keys[prop_id].default_value)
+        self->state |= LOCKDOWN_KEY_BIT (prop_id);
+    }
+}
+
+static gboolean
+lockdown_handle_set_state (HoloLockdown *object,
+                           GDBusMethodInvocation *invocation,
+                           GVariant *arg_state,
+                           GVariant *arg_options,
+                           gpointer data)
+{
+  g_debug ("SetState");
+
+  LockdownManager *self = data;
+
+  /* Otherwise, loading the configuration later would undo this call */
+  lockdown_manager_ensure_loaded (self);
+
+  guint32 state = 0;
+  guint32 seen = 0;
+  gboolean persist = FALSE;
+  GVariantIter iter;
+  const char *name;
+  gboolean disabled;
+
+  g_variant_lookup (arg_options, "persist", "b", &persist);
+
+  g_variant_iter_init (&iter, arg_state);
+  while (g_variant_iter_next (&iter, "{&sb}", &name, &disabled))
+    {
+      guint prop_id;
+
+      for (prop_id = 1; prop_id < N_PROPS; prop_id++)
+        {
+          if (g_str_equal (lockdown_keys[prop_id].dbus_property, name))
+            break;
+        }
+
+      if (prop_id == N_PROPS)
+        {
+          g_dbus_method_invocation_return_error (invocation, XDG_DESKTOP_PORTAL_ERROR,
+                                                 XDG_DESKTOP_PORTAL_ERROR_INVALID_ARGUMENT,
+                                                 "Unknown lockdown property: %s", name);
+          return TRUE;
+        }
+
+      seen |= LOCKDOWN_KEY_BIT (prop_id);
+
+      /* The D-Bus properties are the inverse of ours */
+      if (!disabled)
+        state |= LOCKDOWN_KEY_BIT (prop_id);
+    }
+
+  if (seen != LOCKDOWN_ALL_KEYS)
+    {
+      g_dbus_method_invocation_return_error_literal (invocation, XDG_DESKTOP_PORTAL_ERROR,
+                                                     XDG_DESKTOP_PORTAL_ERROR_INVALID_ARGUMENT,
+                                                     "Incomplete lockdown state");
+      return TRUE;
+    }
+
+  lockdown_manager_set_state (self, state);
+
+  if (persist)
+    {
+      g_autoptr (GKeyFile) kf = g_key_file_new ();
+
+      for (guint prop_id = 1; prop_id < N_PROPS; prop_id++)
+        {
+          const LockdownKeyInfo *info = &lockdown_keys[prop_id];
+
+          g_key_file_set_boolean (kf, info->group, info->key, !lockdown_manager_get_key (self, prop_id));
+        }
+
+      config_source_save (config_source_get_default (), "lockdown.conf", kf);
+    }
+
+  holo_lockdown_complete_set_state (object, invocation);
+
+  return TRUE;
 }
 
 bool
@@ -236,15 +364,13 @@ lockdown_init (GDBusConnection *connection,
         G_DBUS_INTERFACE_SKELETON (xdp_impl_lockdown_skeleton_new ());
 
       LockdownManager *res = g_object_new (lockdown_manager_get_type (), NULL);
+      res->helper = helper;
 
-      GBindingFlags flags = G_BINDING_BIDIRECTIONAL | G_BINDING_INVERT_BOOLEAN;
-      g_object_bind_property (res, "printing", helper, "disable-printing", flags);
-      g_object_bind_property (res, "save-to-disk", helper, "disable-save-to-disk", flags);
-      g_object_bind_property (res, "application-handlers", helper, "disable-application-handlers", flags);
-      g_object_bind_property (res, "location", helper, "disable-location", flags);
-      g_object_bind_property (res, "camera", helper, "disable-camera", flags);
-      g_object_bind_property (res, "microphone", helper, "disable-microphone", flags);
-      g_object_bind_property (res, "sound-output", helper, "disable-sound-output", flags);
+      /* Publish the defaults until the configuration is loaded, and keep
+       * them if there is none */
+      GBindingFlags flags = G_BINDING_BIDIRECTIONAL | G_BINDING_INVERT_BOOLEAN | G_BINDING_SYNC_CREATE;
+      for (guint prop_id = 1; prop_id < N_PROPS; prop_id++)
+        g_object_bind_property (res, lockdown_keys[prop_id].property, helper, lockdown_keys[prop_id].dbus_property, flags);
 
       if (!g_dbus_interface_skeleton_export (helper, connection, DESKTOP_PORTAL_OBJECT_PATH, error))
         {
@@ -254,8 +380,31 @@ lockdown_init (GDBusConnection *connection,
 
       g_debug ("Providing implementation for interface: %s", g_dbus_interface_skeleton_get_info (helper)->name);
 
+      GDBusInterfaceSkeleton *private_helper =
+        G_DBUS_INTERFACE_SKELETON (holo_lockdown_skeleton_new ());
+
+      res->private_helper = private_helper;
+
+      g_signal_connect (private_helper, "handle-set-state", G_CALLBACK (lockdown_handle_set_state), res);
+
+      if (!g_dbus_interface_skeleton_export (private_helper, connection, DESKTOP_PORTAL_OBJECT_PATH, error))
+        {
+          g_dbus_interface_skeleton_unexport (helper);
+          g_object_unref (res);
+          return false;
+        }
+
+      g_debug ("Providing implementation for interface: %s", g_dbus_interface_skeleton_get_info (private_helper)->name);
+
       g_once_init_leave_pointer (&manager, res);
     }
 
   return true;
 }
+
+void
+lockdown_load (void)
+{
+  if (manager != NULL)
+    lockdown_manager_ensure_loaded (manager);
+}
@@ -13,4 +13,7 @@ G_BEGIN_DECLS
 bool
 lockdown_init (GDBusConnection *bus, GError **error);
 
+void
+lockdown_load (void);
+
 G_END_DECLS
@@ -0,0 +1,284 @@
+// rate-limit.c: Rate limiting of the calls starting processes
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "config.h"
+
+#include "rate-limit.h"
+
+#include "config-source.h"
+
+#include "holo-dbus.h"
+#include "utils.h"
+
+#define RATELIMIT_CONF "ratelimit.conf"
+#define APPLICATION_GROUP "Application"
+
+/* Idle buckets are only dropped once there are this many of them, and the
+ * least recently used ones go when none is idle */
+#define MAX_BUCKETS 64
+
+/* A token bucket holding up to @burst tokens, and refilled with @rate
+ * tokens per second; a burst of 0 disables the limit */
+typedef struct
+{
+  guint burst;
+  double rate;
+} RateLimit;
+
+typedef struct
+{
+  double tokens;
+
+  /* Also the time of the last use, since using a bucket refills it */
+  gint64 refill_time;
+} RateBucket;
+
+typedef struct
+{
+  RateLimit limit;
+
+  /* HashTable<owned str, RateBucket> */
+  GHashTable *buckets;
+} RateLimitTable;
+
+struct _RateLimiter
+{
+  RateLimitTable apps;
+
+  guint64 n_accepted;
+  guint64 n_rejected;
+
+  guint config_id;
+};
+
+static const RateLimit default_app_limit = { .burst = 10, .rate = 2.0 };
+
+static RateLimiter *default_limiter;
+
+static void
+rate_limit_table_init (RateLimitTable *table,
+                       const RateLimit *limit)
+{
+  table->limit = *limit;
+  table->buckets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+}
+
+static void
+rate_bucket_refill (RateBucket *bucket,
+                    const RateLimit *limit,
+                    gint64 now)
+{
+  double elapsed = (double) (now - bucket->refill_time) / G_USEC_PER_SEC;
+
+  bucket->tokens = MIN ((double) limit->burst, bucket->tokens + elapsed * limit->rate);
+  bucket->refill_time = now;
+}
+
+/* Buckets left unused for long enough to fill up again are no different
+ * from new ones; if none was, the least recently used one goes, so that
+ * the table stays bounded however many applications call */
+static void
+rate_limit_table_prune (RateLimitTable *table,
+                        gint64 now)
+{
+  gint64 max_idle = (gint64) (table->limit.burst / table->limit.rate * G_USEC_PER_SEC);
+  const char *oldest_key = NULL;
+  gint64 oldest_time = G_MAXINT64;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, table->buckets);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      RateBucket *bucket = value;
+
+      if (now - bucket->refill_time >= max_idle)
+        {
+          g_hash_table_iter_remove (&iter);
+        }
+      else if (bucket->refill_time < oldest_time)
+        {
+          oldest_key = key;
+          oldest_time = bucket->refill_time;
+        }
+    }
+
+  if (g_hash_table_size (table->buckets) >= MAX_BUCKETS && oldest_key != NULL)
+    g_hash_table_remove (table->buckets, oldest_key);
+}
+
+/* Returns the bucket of @key, refilled, or NULL if there is no limit */
+static RateBucket *
+rate_limit_table_get_bucket (RateLimitTable *table,
+                             const char *key,
+                             gint64 now)
+{
+  if (table->limit.burst == 0)
+    return NULL;
+
+  RateBucket *bucket = g_hash_table_lookup (table->buckets, key);
+
+  if (bucket == NULL)
+    {
+      if (g_hash_table_size (table->buckets) >= MAX_BUCKETS)
+        rate_limit_table_prune (table, now);
+
+      bucket = g_new0 (RateBucket, 1);
+      bucket->tokens = table->limit.burst;
+      bucket->refill_time = now;
+      g_hash_table_insert (table->buckets, g_strdup (key), bucket);
+    }
+  else
+    {
+      rate_bucket_refill (bucket, &table->limit, now);
+    }
+
+  return bucket;
+}
+
+static void
+load_rate_limit (GKeyFile *kf,
+                 const char *group,
+                 const RateLimit *default_limit,
+                 RateLimitTable *table)
+{
+  g_autoptr (GError) error = NULL;
+  RateLimit limit = *default_limit;
+
+  if (g_key_file_has_key (kf, group, "Burst", NULL))
+    {
+      int burst = g_key_file_get_integer (kf, group, "Burst", &error);
+
+      if (error != NULL || burst < 0)
+        g_warning ("Invalid %s burst in " RATELIMIT_CONF, group);
+      else
+        limit.burst = burst;
+
+      g_clear_error (&error);
+    }
+
+  if (g_key_file_has_key (kf, group, "Rate", NULL))
+    {
+      double rate = g_key_file_get_double (kf, group, "Rate", &error);
+
+      if (error != NULL || rate <= 0)
+        g_warning ("Invalid %s rate in " RATELIMIT_CONF, group);
+      else
+        limit.rate = rate;
+    }
+
+  g_debug ("%s limit: burst of %u, %g per second", group, limit.burst, limit.rate);
+
+  /* The buckets are refilled with the new rate from now on */
+  table->limit = limit;
+}
+
+static void
+load_rate_limit_config (GKeyFile *kf,
+                        const char * const *changed_groups,
+                        bool notify,
+                        gpointer user_data)
+{
+  RateLimiter *self = user_data;
+
+  if (!notify || g_strv_contains (changed_groups, APPLICATION_GROUP))
+    load_rate_limit (kf, APPLICATION_GROUP, &default_app_limit, &self->apps);
+}
+
+static RateLimiter *
+rate_limiter_new (void)
+{
+  RateLimiter *self = g_new0 (RateLimiter, 1);
+
+  rate_limit_table_init (&self->apps, &default_app_limit);
+
+  self->config_id = config_source_subscribe (config_source_get_default (),
+                                             RATELIMIT_CONF,
+                                             CONFIG_SOURCE_FLAGS_NONE,
+                                             load_rate_limit_config,
+                                             self);
+
+  return self;
+}
+
+RateLimiter *
+rate_limiter_get_default (void)
+{
+  if (g_once_init_enter_pointer (&default_limiter))
+    g_once_init_leave_pointer (&default_limiter, rate_limiter_new ());
+
+  return default_limiter;
+}
+
+bool
+rate_limiter_consume (RateLimiter *self,
+                      const char *app_id)
+{
+  /* Every call comes from the frontend, so the D-Bus sender does not tell
+   * callers apart, and applications running on the host all share the
+   * empty ID. Those can start processes on their own anyway, so only
+   * sandboxed applications are limited */
+  if (app_id == NULL || app_id[0] == '\0')
+    {
+      self->n_accepted++;
+      return true;
+    }
+
+  RateBucket *bucket = rate_limit_table_get_bucket (&self->apps, app_id, g_get_monotonic_time ());
+
+  if (bucket != NULL && bucket->tokens < 1)
+    {
+      self->n_rejected++;
+      g_debug ("Rate limiting %s; %" G_GUINT64_FORMAT " calls rejected so far",
+               app_id, self->n_rejected);
+      return false;
+    }
+
+  if (bucket != NULL)
+    bucket->tokens -= 1;
+
+  self->n_accepted++;
+
+  return true;
+}
+
+static bool
+rate_limit_handle_get_counters (HoloRateLimit *object,
+                                GDBusMethodInvocation *invocation,
+                                gpointer user_data)
+{
+  RateLimiter *self = rate_limiter_get_default ();
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "accepted", g_variant_new_uint64 (self->n_accepted));
+  g_variant_builder_add (&builder, "{sv}", "rejected", g_variant_new_uint64 (self->n_rejected));
+
+  holo_rate_limit_complete_get_counters (object, invocation, g_variant_builder_end (&builder));
+
+  return true;
+}
+
+bool
+rate_limit_init (GDBusConnection *connection,
+                 GError **error)
+{
+  GDBusInterfaceSkeleton *helper =
+    G_DBUS_INTERFACE_SKELETON (holo_rate_limit_skeleton_new ());
+
+  /* The limiter, and its configuration, are only loaded by the first call
+   * that needs them */
+  g_signal_connect (helper, "handle-get-counters", G_CALLBACK (rate_limit_handle_get_counters), NULL);
+
+  if (!g_dbus_interface_skeleton_export (helper, connection, DESKTOP_PORTAL_OBJECT_PATH, error))
+    {
+      return false;
+    }
+
+  g_debug ("Providing implementation for interface: %s",
+           g_dbus_interface_skeleton_get_info (helper)->name);
+
+  return true;
+}
@@ -0,0 +1,28 @@
+// rate-limit.h: Rate limiting of the calls starting processes
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#pragma once
+
+#include <gio/gio.h>
+#include <stdbool.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RateLimiter RateLimiter;
+
+/* Returns the limiter, which follows ratelimit.conf */
+RateLimiter *
+rate_limiter_get_default (void);
+
+/* Takes a token from the bucket of @app_id, or returns false if it is
+ * empty; applications running on the host are not limited */
+bool
+rate_limiter_consume (RateLimiter *self,
+                      const char *app_id);
+
+bool
+rate_limit_init (GDBusConnection *bus, GError **error);
+
+G_END_DECLS
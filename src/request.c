@@ -23,6 +23,32 @@
 
 #include <string.h>
 
+/* Number of released requests kept around for reuse */
+#define REQUEST_POOL_SIZE 8
+
+/* Requests are only handled from the main thread, so none of these needs
+ * locking */
+static GPtrArray *request_pool;
+
+/* Handle -> Request, for every acquired request; the keys are owned by the
+ * requests */
+static GHashTable *requests;
+
+/* Sender -> SenderRequests, for the same requests. The sender is always
+ * xdg-desktop-portal itself, which closes the requests of applications
+ * that exit with Request.Close, so this only catches the frontend going
+ * away and leaving its requests behind. */
+static GHashTable *requests_by_sender;
+
+typedef struct
+{
+  /* Set of Request */
+  GHashTable *requests;
+
+  /* Watch on the sender's unique name, made on the first export */
+  guint watch_id;
+} SenderRequests;
+
 static void request_skeleton_iface_init (XdpImplRequestIface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (Request, request, XDP_IMPL_TYPE_REQUEST_SKELETON,
@@ -35,6 +61,17 @@ handle_close (XdpImplRequest *object,
   Request *request = (Request *)object;
   g_autoptr(GError) error = NULL;
 
+  /* Calls queued before the request was released must not close the one
+   * it got recycled into */
+  if (!request->in_use ||
+      g_strcmp0 (g_dbus_method_invocation_get_object_path (invocation), request->id) != 0)
+    {
+      xdp_impl_request_complete_close (XDP_IMPL_REQUEST (request), invocation);
+      return TRUE;
+    }
+
+  g_cancellable_cancel (request->cancellable);
+
   if (request->exported)
     request_unexport (request);
 
@@ -62,6 +99,7 @@ request_finalize (GObject *object)
   g_free (request->sender);
   g_free (request->app_id);
   g_free (request->id);
+  g_clear_object (&request->cancellable);
 
   G_OBJECT_CLASS (request_parent_class)->finalize (object);
 }
@@ -86,16 +124,86 @@ request_new (const char *sender,
   request->sender = g_strdup (sender);
   request->app_id = g_strdup (app_id);
   request->id = g_strdup (id);
+  request->cancellable = g_cancellable_new ();
 
   return request;
 }
 
+static void
+sender_requests_free (SenderRequests *sender_requests)
+{
+  if (sender_requests->watch_id != 0)
+    g_bus_unwatch_name (sender_requests->watch_id);
+
+  g_hash_table_unref (sender_requests->requests);
+  g_free (sender_requests);
+}
+
+/* Cancels the work of every request of a sender that left the bus, and
+ * unexports them; their owners still release them as usual once the work
+ * is over */
+static void
+on_sender_vanished (GDBusConnection *connection,
+                    const char *name,
+                    gpointer user_data)
+{
+  SenderRequests *sender_requests = NULL;
+
+  /* Unique names never come back, so the watch is not needed anymore */
+  if (requests_by_sender == NULL ||
+      !g_hash_table_steal_extended (requests_by_sender, name, NULL, (gpointer *) &sender_requests))
+    return;
+
+  g_debug ("%s left the bus, closing its %u requests", name, g_hash_table_size (sender_requests->requests));
+
+  GHashTableIter iter;
+  gpointer key;
+
+  g_hash_table_iter_init (&iter, sender_requests->requests);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      Request *request = key;
+
+      g_cancellable_cancel (request->cancellable);
+
+      if (request->exported)
+        request_unexport (request);
+    }
+
+  sender_requests_free (sender_requests);
+}
+
+/* Watches the unique name of @request's sender, once per sender */
+static void
+watch_sender (Request *request,
+              GDBusConnection *connection)
+{
+  SenderRequests *sender_requests = NULL;
+
+  if (request->sender != NULL && requests_by_sender != NULL)
+    sender_requests = g_hash_table_lookup (requests_by_sender, request->sender);
+
+  if (sender_requests == NULL || sender_requests->watch_id != 0)
+    return;
+
+  sender_requests->watch_id =
+    g_bus_watch_name_on_connection (connection,
+                                    request->sender,
+                                    G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                    NULL,
+                                    on_sender_vanished,
+                                    NULL,
+                                    NULL);
+}
+
 void
 request_export (Request *request,
                 GDBusConnection *connection)
 {
   g_autoptr(GError) error = NULL;
 
+  watch_sender (request, connection);
+
   if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (request),
                                          connection,
                                          request->id,
@@ -116,3 +224,122 @@ request_unexport (Request *request)
   g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (request));
   g_object_unref (request);
 }
+
+/* Returns a request for the handle @id, reusing a released one if possible.
+ * The request is tracked until request_release() is called, but it is only
+ * exported on the bus if request_export() is called as well, which is only
+ * needed when the interaction can outlive the method call. */
+Request *
+request_acquire (const char *sender,
+                 const char *app_id,
+                 const char *id)
+{
+  Request *request;
+
+  if (request_pool != NULL && request_pool->len > 0)
+    {
+      request = g_ptr_array_steal_index_fast (request_pool, request_pool->len - 1);
+      request->sender = g_strdup (sender);
+      request->app_id = g_strdup (app_id);
+      request->id = g_strdup (id);
+    }
+  else
+    {
+      request = request_new (sender, app_id, id);
+    }
+
+  request->in_use = TRUE;
+
+  if (requests == NULL)
+    requests = g_hash_table_new (g_str_hash, g_str_equal);
+
+  if (g_hash_table_contains (requests, id))
+    {
+      g_warning ("Request handle %s is already in use", id);
+      return request;
+    }
+
+  g_hash_table_insert (requests, request->id, request);
+
+  if (sender != NULL)
+    {
+      if (requests_by_sender == NULL)
+        requests_by_sender = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                    g_free, (GDestroyNotify) sender_requests_free);
+
+      SenderRequests *sender_requests = g_hash_table_lookup (requests_by_sender, sender);
+      if (sender_requests == NULL)
+        {
+          sender_requests = g_new0 (SenderRequests, 1);
+          sender_requests->requests = g_hash_table_new (NULL, NULL);
+          g_hash_table_insert (requests_by_sender, g_strdup (sender), sender_requests);
+        }
+
+      g_hash_table_add (sender_requests->requests, request);
+    }
+
+  return request;
+}
+
+/* Stops tracking @request, unexporting it if needed, and drops the
+ * reference returned by request_acquire() */
+void
+request_release (Request *request)
+{
+  g_return_if_fail (request->in_use);
+
+  request->in_use = FALSE;
+
+  if (request->exported)
+    request_unexport (request);
+
+  if (g_hash_table_lookup (requests, request->id) == request)
+    {
+      g_hash_table_remove (requests, request->id);
+
+      /* The sender's set is gone if it left the bus already, and dropping
+       * the last request of a sender stops watching it */
+      SenderRequests *sender_requests = NULL;
+      if (request->sender != NULL && requests_by_sender != NULL)
+        sender_requests = g_hash_table_lookup (requests_by_sender, request->sender);
+
+      if (sender_requests != NULL &&
+          g_hash_table_remove (sender_requests->requests, request) &&
+          g_hash_table_size (sender_requests->requests) == 0)
+        g_hash_table_remove (requests_by_sender, request->sender);
+    }
+
+  if (request_pool == NULL)
+    request_pool = g_ptr_array_new_with_free_func (g_object_unref);
+
+  /* The request is neither exported nor in use anymore, so the reference
+   * returned by request_acquire() is the only one that matters */
+  if (request_pool->len < REQUEST_POOL_SIZE)
+    {
+      g_clear_pointer (&request->sender, g_free);
+      g_clear_pointer (&request->app_id, g_free);
+      g_clear_pointer (&request->id, g_free);
+
+      /* Cancellation cannot be undone once it happened */
+      if (g_cancellable_is_cancelled (request->cancellable))
+        {
+          g_object_unref (request->cancellable);
+          request->cancellable = g_cancellable_new ();
+        }
+
+      g_ptr_array_add (request_pool, request);
+      return;
+    }
+
+  g_object_unref (request);
+}
+
+/* Returns the acquired request for the handle @id, or NULL */
+Request *
+request_lookup (const char *id)
+{
+  if (requests == NULL)
+    return NULL;
+
+  return g_hash_table_lookup (requests, id);
+}
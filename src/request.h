@@ -31,9 +31,16 @@ struct _Request
   XdpImplRequestSkeleton parent_instance;
 
   gboolean exported;
+
+  /* Set between request_acquire() and request_release() */
+  gboolean in_use;
+
   char *sender;
   char *app_id;
   char *id;
+
+  /* Cancelled by Close */
+  GCancellable *cancellable;
 };
 
 struct _RequestClass
@@ -49,6 +56,13 @@ Request *request_new (const char *sender,
                       const char *app_id,
                       const char *id);
 
+Request *request_acquire (const char *sender,
+                          const char *app_id,
+                          const char *id);
+void request_release (Request *request);
+
+Request *request_lookup (const char *id);
+
 void request_export (Request *request,
                      GDBusConnection *connection);
 void request_unexport (Request *request);
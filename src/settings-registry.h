@@ -0,0 +1,109 @@
+// settings-registry.h: Known Settings namespaces and keys
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  SETTING_STRING_VALUE,
+  SETTING_INT_VALUE,
+  SETTING_COLOR_VALUE
+} SettingValueType;
+
+typedef union
+{
+  char *v_str;
+  int v_int;
+  struct {
+    double red;
+    double green;
+    double blue;
+  } v_color;
+} SettingData;
+
+/* Colour components closer than this are considered equal */
+#define SETTING_COLOR_EPSILON 1e-6
+
+typedef struct _SettingInfo SettingInfo;
+
+struct _SettingInfo
+{
+  /* Position in the table of all settings */
+  unsigned int index;
+
+  const char *namespace;
+  const char *key;
+
+  SettingValueType value_type;
+  const char *type_string;
+  SettingData default_value;
+
+  /* Reads the value of the setting from @key_file into @data, falling
+   * back to the default value; string values are newly allocated */
+  void (* parse) (const SettingInfo *info,
+                  GKeyFile *key_file,
+                  SettingData *data);
+
+  /* Writes @data into @key_file, in the format expected by parse() */
+  void (* save) (const SettingInfo *info,
+                 GKeyFile *key_file,
+                 const SettingData *data);
+
+  /* Returns a floating reference */
+  GVariant *(* serialize) (const SettingData *data);
+
+  /* Reads the value of the setting from @variant, of type type_string,
+   * into @data; string values are newly allocated */
+  void (* deserialize) (GVariant *variant,
+                        SettingData *data);
+
+  gboolean (* equal) (const SettingData *a,
+                      const SettingData *b);
+};
+
+typedef struct
+{
+  /* Position in the table of all namespaces */
+  unsigned int index;
+
+  const char *namespace;
+
+  const SettingInfo *settings;
+  size_t n_settings;
+} SettingNamespaceInfo;
+
+// The implementation is generated at build time from settings-schema.ini
+// by gen-settings-registry.py
+//
+// Namespaces are sorted by name, and the settings of each namespace are
+// contiguous in the table of all settings; namespace and key strings are
+// static, and can be used as keys without copying them.
+
+/* Returns a checksum of the schema, which changes whenever the set of
+ * namespaces and keys, or their types, change */
+const char *
+settings_registry_get_checksum (void);
+
+size_t
+settings_registry_get_n_settings (void);
+
+size_t
+settings_registry_get_n_namespaces (void);
+
+const SettingNamespaceInfo *
+settings_registry_get_namespaces (void);
+
+const SettingNamespaceInfo *
+settings_registry_lookup_namespace (const char *namespace);
+
+const SettingInfo *
+settings_registry_lookup (const char *namespace,
+                          const char *key);
+
+G_END_DECLS
@@ -6,351 +6,594 @@
 #include "config.h"
 
 #include "settings.h"
+#include "settings-registry.h"
 
+#include "config-db.h"
+#include "config-source.h"
+
+#include "holo-dbus.h"
 #include "utils.h"
 #include "xdg-desktop-portal-dbus.h"
 
 G_DECLARE_FINAL_TYPE (SettingsManager, settings_manager, SETTINGS, MANAGER, GObject)
 
+typedef struct
+{
+  /* NULL if the key is not set */
+  const SettingInfo *info;
+
+  /* String values point into SettingsManager.strings */
+  SettingData value;
+
+  /* The value serialized as info->type_string, which may point into the
+   * configuration image */
+  GVariant *serialized;
+} SettingValue;
+
+typedef struct
+{
+  const SettingNamespaceInfo *info;
+
+  /* Array<SettingValue>, indexed like info->settings; a slice of
+   * SettingsManager.values */
+  SettingValue *values;
+
+  /* Serialized copy of the values that are set, or NULL if none is;
+   * type: a{sv} */
+  GVariant *serialized;
+} SettingNamespace;
+
 struct _SettingsManager
 {
   GObject parent_instance;
 
   GDBusInterfaceSkeleton *helper;
+  GDBusInterfaceSkeleton *private_helper;
+
+  /* Array<SettingValue>, indexed like the registry settings */
+  SettingValue *values;
 
-  /* HashTable<unowned str, SettingNamespace> */
-  GHashTable *keys;
+  /* Array<SettingNamespace>, indexed like the registry namespaces, and
+   * thus sorted by namespace */
+  SettingNamespace *namespaces;
+  size_t n_namespaces;
 
-  GFileMonitor *file_monitor;
+  /* Storage for the string values of the current snapshot, replaced as a
+   * whole whenever a string value changes */
+  GStringChunk *strings;
+
+  /* Serialized copy of values, as returned by ReadAll; type: a{sa{sv}} */
+  GVariant *snapshot;
+
+  bool loaded;
+  guint config_id;
 };
 
-typedef enum
-{
-  SETTING_STRING_VALUE,
-  SETTING_INT_VALUE,
-  SETTING_COLOR_VALUE
-} SettingValueType;
+static SettingsManager *manager;
 
-typedef struct
+static void
+setting_data_clear (SettingValueType value_type,
+                    SettingData *data)
 {
-  SettingValueType value_type;
-  char *namespace;
-  char *key;
-
-  union {
-    char *v_str;
-    int v_int;
-    struct {
-      double red;
-      double green;
-      double blue;
-    } v_color;
-  } value;
-} SettingValue;
+  switch (value_type)
+    {
+    case SETTING_STRING_VALUE:
+      g_clear_pointer (&data->v_str, g_free);
+      break;
 
+    case SETTING_INT_VALUE:
+    case SETTING_COLOR_VALUE:
+      break;
+
+    default:
+      g_assert_not_reached ();
+      break;
+    }
+}
+
+/* A value read from the configuration, that replaces the stored one */
 typedef struct
 {
-  char *namespace;
+  const SettingInfo *info;
 
-  /* HashTable<unowned str, SettingValue> */
-  GHashTable *keys;
-} SettingNamespace;
+  /* String values are newly allocated */
+  SettingData data;
 
-static SettingsManager *manager;
+  /* The already serialized value, if available */
+  GVariant *serialized;
+} SettingChange;
 
-static SettingValue *
-setting_value_new_int (const char *namespace,
-                       const char *key,
-                       int value)
+static void
+setting_change_clear (gpointer data)
 {
-  SettingValue *v = g_new0 (SettingValue, 1);
-
-  v->value_type = SETTING_INT_VALUE;
-  v->namespace = g_strdup (namespace);
-  v->key = g_strdup (key);
-  v->value.v_int = value;
+  SettingChange *change = data;
 
-  return v;
+  setting_data_clear (change->info->value_type, &change->data);
+  g_clear_pointer (&change->serialized, g_variant_unref);
 }
 
-#if 0
-static SettingValue *
-setting_value_new_string (const char *namespace,
-                          const char *key,
-                          const char *value)
+typedef struct
 {
-  SettingValue *v = g_new0 (SettingValue, 1);
+  const char *str;
+  size_t len;
+} NamespacePrefix;
 
-  v->value_type = SETTING_STRING_VALUE;
-  v->namespace = g_strdup (namespace);
-  v->key = g_strdup (key);
-  v->value.v_str = g_strdup (value);
+/* A compiled set of ReadAll namespace patterns */
+typedef struct
+{
+  bool match_all;
+
+  /* Array<unowned str> */
+  GPtrArray *exact;
 
-  return v;
+  /* Array<NamespacePrefix>, sorted, and without any entry that is covered
+   * by a shorter prefix */
+  GArray *prefixes;
+} NamespaceFilter;
+
+static void
+namespace_filter_free (NamespaceFilter *filter)
+{
+  if (filter != NULL)
+    {
+      g_ptr_array_unref (filter->exact);
+      g_array_unref (filter->prefixes);
+      g_free (filter);
+    }
 }
-#endif
 
-static SettingValue *
-setting_value_new_color (const char *namespace,
-                         const char *key,
-                         size_t n_colors,
-                         double *colors)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (NamespaceFilter, namespace_filter_free)
+
+static int
+namespace_prefix_compare (gconstpointer a,
+                          gconstpointer b)
 {
-  SettingValue *v = g_new0 (SettingValue, 1);
+  const NamespacePrefix *prefix_a = a;
+  const NamespacePrefix *prefix_b = b;
 
-  v->value_type = SETTING_COLOR_VALUE;
-  v->namespace = g_strdup (namespace);
-  v->key = g_strdup (key);
-  v->value.v_color.red = n_colors > 0 ? colors[0] : 0.0;
-  v->value.v_color.green = n_colors > 1 ? colors[1] : 0.0;
-  v->value.v_color.blue = n_colors > 2 ? colors[2] : 0.0;
+  int res = strncmp (prefix_a->str, prefix_b->str, MIN (prefix_a->len, prefix_b->len));
+  if (res != 0)
+    return res;
 
-  return v;
+  return (prefix_a->len > prefix_b->len) - (prefix_a->len < prefix_b->len);
 }
 
-static void
-setting_value_free (gpointer data)
+/* The returned filter borrows the strings of @patterns */
+static NamespaceFilter *
+namespace_filter_compile (const char * const *patterns)
 {
-  if (data != NULL)
+  NamespaceFilter *filter = g_new0 (NamespaceFilter, 1);
+  size_t i;
+
+  filter->exact = g_ptr_array_new ();
+  filter->prefixes = g_array_new (FALSE, FALSE, sizeof (NamespacePrefix));
+
+  for (i = 0; patterns[i]; ++i)
     {
-      SettingValue *value = data;
+      const char *pattern = patterns[i];
+      size_t pattern_len = strlen (pattern);
 
-      switch (value->value_type)
+      if (pattern_len == 0 || (pattern_len == 1 && pattern[0] == '*'))
         {
-        case SETTING_STRING_VALUE:
-          g_free (value->value.v_str);
-          break;
+          filter->match_all = true;
+          return filter;
+        }
 
-        case SETTING_INT_VALUE:
-        case SETTING_COLOR_VALUE:
-          break;
+      if (pattern[pattern_len - 1] == '*')
+        {
+          NamespacePrefix prefix = { pattern, pattern_len - 1 };
+          g_array_append_val (filter->prefixes, prefix);
+        }
+      else
+        {
+          g_ptr_array_add (filter->exact, (gpointer) pattern);
+        }
+    }
 
-        default:
-          g_assert_not_reached ();
-          break;
+  if (i == 0) /* Empty array */
+    {
+      filter->match_all = true;
+      return filter;
+    }
+
+  /* Once sorted, a prefix covering another one comes right before it */
+  g_array_sort (filter->prefixes, namespace_prefix_compare);
+
+  guint n_prefixes = 0;
+  for (guint j = 0; j < filter->prefixes->len; j++)
+    {
+      NamespacePrefix *prefix = &g_array_index (filter->prefixes, NamespacePrefix, j);
+
+      if (n_prefixes > 0)
+        {
+          NamespacePrefix *last = &g_array_index (filter->prefixes, NamespacePrefix, n_prefixes - 1);
+          if (strncmp (prefix->str, last->str, last->len) == 0)
+            continue;
         }
 
-      g_free (value->namespace);
-      g_free (value->key);
-      g_free (value);
+      g_array_index (filter->prefixes, NamespacePrefix, n_prefixes++) = *prefix;
     }
+
+  g_array_set_size (filter->prefixes, n_prefixes);
+
+  return filter;
 }
 
-static GVariant *
-setting_value_to_gvariant (SettingValue *value)
+/* Returns the index of the first namespace that does not sort before the
+ * first @len bytes of @str */
+static size_t
+settings_manager_lower_bound (SettingsManager *self,
+                              const char *str,
+                              size_t len)
 {
-  GVariant *res;
+  size_t lo = 0;
+  size_t hi = self->n_namespaces;
 
-  switch (value->value_type)
+  while (lo < hi)
     {
-    case SETTING_STRING_VALUE:
-      res = g_variant_new_string (value->value.v_str);
-      break;
+      size_t mid = lo + (hi - lo) / 2;
 
-    case SETTING_INT_VALUE:
-      res = g_variant_new_int32 (value->value.v_int);
-      break;
+      if (strncmp (self->namespaces[mid].info->namespace, str, len) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
 
-    case SETTING_COLOR_VALUE:
-      res = g_variant_new ("(ddd)",
-                           value->value.v_color.red,
-                           value->value.v_color.green,
-                           value->value.v_color.blue);
-      break;
+  return lo;
+}
 
-    default:
-      g_assert_not_reached ();
+/* Marks in @selected, indexed like self->namespaces, the namespaces
+ * matching @filter */
+static void
+settings_manager_select_namespaces (SettingsManager *self,
+                                    const NamespaceFilter *filter,
+                                    bool *selected)
+{
+  for (guint i = 0; i < filter->exact->len; i++)
+    {
+      const char *name = g_ptr_array_index (filter->exact, i);
+      size_t idx = settings_manager_lower_bound (self, name, G_MAXSIZE);
+
+      if (idx < self->n_namespaces && strcmp (self->namespaces[idx].info->namespace, name) == 0)
+        selected[idx] = true;
     }
 
-  return res;
+  for (guint i = 0; i < filter->prefixes->len; i++)
+    {
+      const NamespacePrefix *prefix = &g_array_index (filter->prefixes, NamespacePrefix, i);
+
+      for (size_t idx = settings_manager_lower_bound (self, prefix->str, prefix->len);
+           idx < self->n_namespaces;
+           idx++)
+        {
+          if (strncmp (self->namespaces[idx].info->namespace, prefix->str, prefix->len) != 0)
+            break;
+
+          selected[idx] = true;
+        }
+    }
 }
 
-static SettingNamespace *
-setting_namespace_new (const char *namespace)
+static inline SettingValue *
+settings_manager_get_key (SettingsManager *self,
+                          const SettingInfo *info)
 {
-  SettingNamespace *ns = g_new0 (SettingNamespace, 1);
+  SettingValue *value = &self->values[info->index];
 
-  ns->namespace = g_strdup (namespace);
-  ns->keys = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, setting_value_free);
-
-  return ns;
+  return value->info != NULL ? value : NULL;
 }
 
+/* Stores the values of @changes, of type Array<SettingChange>, into the
+ * store; if any of them is a string, the string values are moved into a
+ * new arena, so that replaced strings are released all at once */
 static void
-setting_namespace_free (gpointer data)
+settings_manager_apply_changes (SettingsManager *self,
+                                GArray *changes)
 {
-  if (data != NULL)
+  GStringChunk *strings = NULL;
+
+  for (guint i = 0; i < changes->len; i++)
+    {
+      if (g_array_index (changes, SettingChange, i).info->value_type == SETTING_STRING_VALUE)
+        {
+          strings = g_string_chunk_new (256);
+          break;
+        }
+    }
+
+  if (strings != NULL)
     {
-      SettingNamespace *ns = data;
+      size_t n_settings = settings_registry_get_n_settings ();
 
-      g_free (ns->namespace);
-      g_hash_table_unref (ns->keys);
-      g_free (ns);
+      for (size_t i = 0; i < n_settings; i++)
+        {
+          SettingValue *value = &self->values[i];
+
+          if (value->info != NULL && value->info->value_type == SETTING_STRING_VALUE)
+            value->value.v_str = g_string_chunk_insert (strings, value->value.v_str);
+        }
+    }
+
+  for (guint i = 0; i < changes->len; i++)
+    {
+      SettingChange *change = &g_array_index (changes, SettingChange, i);
+      SettingValue *value = &self->values[change->info->index];
+
+      value->info = change->info;
+      value->value = change->data;
+
+      if (change->info->value_type == SETTING_STRING_VALUE)
+        {
+          value->value.v_str = g_string_chunk_insert (strings, change->data.v_str);
+          g_clear_pointer (&change->data.v_str, g_free);
+        }
+
+      g_clear_pointer (&value->serialized, g_variant_unref);
+      if (change->serialized != NULL)
+        value->serialized = g_steal_pointer (&change->serialized);
+      else
+        value->serialized = g_variant_ref_sink (change->info->serialize (&value->value));
+    }
+
+  if (strings != NULL)
+    {
+      g_clear_pointer (&self->strings, g_string_chunk_free);
+      self->strings = strings;
     }
 }
 
-static bool
-namespace_matches (const char         *namespace,
-                   const char * const *patterns)
+static void
+settings_manager_rebuild_snapshot (SettingsManager *self)
 {
-  size_t i;
+  GVariantBuilder builder;
 
-  for (i = 0; patterns[i]; ++i)
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+
+  for (size_t i = 0; i < self->n_namespaces; i++)
     {
-      size_t pattern_len;
-      const char *pattern = patterns[i];
-      if (pattern[0] == '\0')
-        return true;
+      SettingNamespace *ns = &self->namespaces[i];
+      GVariantBuilder dict;
+      bool empty = true;
+
+      g_variant_builder_init (&dict, G_VARIANT_TYPE ("a{sv}"));
+
+      for (size_t j = 0; j < ns->info->n_settings; j++)
+        {
+          SettingValue *value = &ns->values[j];
+
+          if (value->info == NULL)
+            continue;
+
+          g_variant_builder_add (&dict, "{sv}", value->info->key, value->serialized);
+          empty = false;
+        }
 
-      if (strcmp (namespace, pattern) == 0)
-        return true;
+      g_clear_pointer (&ns->serialized, g_variant_unref);
 
-      pattern_len = strlen (pattern);
-      if (pattern[pattern_len - 1] == '*' && strncmp (namespace, pattern, pattern_len - 1) == 0)
-        return true;
+      if (empty)
+        {
+          g_variant_builder_clear (&dict);
+          continue;
+        }
+
+      ns->serialized = g_variant_ref_sink (g_variant_builder_end (&dict));
+
+      g_variant_builder_add (&builder, "{s@a{sv}}", ns->info->namespace, ns->serialized);
     }
 
-  if (i == 0) /* Empty array */
-    return true;
+  g_clear_pointer (&self->snapshot, g_variant_unref);
+  self->snapshot = g_variant_ref_sink (g_variant_builder_end (&builder));
+}
 
-  return false;
+static void
+settings_manager_emit_changed (SettingsManager *self,
+                               SettingValue *value)
+{
+  xdp_impl_settings_emit_setting_changed (XDP_IMPL_SETTINGS (self->helper),
+                                          value->info->namespace,
+                                          value->info->key,
+                                          g_variant_new_variant (value->serialized));
 }
 
-static inline bool
-settings_manager_set_key (SettingsManager *self,
-                          SettingValue *value)
+/* Applies @changes, of type Array<SettingChange>, and notifies them if
+ * @notify is set; returns whether any key changed */
+static bool
+settings_manager_commit (SettingsManager *self,
+                         GArray *changes,
+                         bool notify)
 {
-  SettingNamespace *ns = g_hash_table_lookup (self->keys, value->namespace);
-  if (ns == NULL)
+  settings_manager_apply_changes (self, changes);
+
+  for (guint i = 0; i < changes->len; i++)
     {
-      ns = setting_namespace_new (value->namespace);
-      g_hash_table_insert (self->keys, value->namespace, ns);
+      const SettingInfo *info = g_array_index (changes, SettingChange, i).info;
+
+      g_debug ("Setting changed: %s %s", info->namespace, info->key);
+
+      if (notify)
+        settings_manager_emit_changed (self, &self->values[info->index]);
     }
 
-  return g_hash_table_replace (ns->keys, value->key, value);
+  return changes->len > 0;
 }
 
-static inline SettingValue *
-settings_manager_get_key (SettingsManager *self,
-                          const char *namespace,
-                          const char *key)
+/* Parses the @groups of @key_file into a scratch set of values, and only
+ * replaces (and notifies) the keys whose value differs from the current
+ * one; returns whether any key changed */
+static bool
+load_settings (SettingsManager *settings_manager,
+               GKeyFile *key_file,
+               const char * const *groups,
+               bool notify)
 {
-  SettingNamespace *ns = g_hash_table_lookup (self->keys, namespace);
-  if (ns == NULL)
-    return NULL;
+  g_autoptr (GArray) changes = g_array_new (FALSE, FALSE, sizeof (SettingChange));
 
-  return g_hash_table_lookup (ns->keys, key);
-}
+  g_array_set_clear_func (changes, setting_change_clear);
 
-static bool load_settings_config (SettingsManager *settings_manager,
-                                  bool notify);
+  for (gsize i = 0; groups[i] != NULL; i++)
+    {
+      /* Keep the current values of removed groups */
+      if (!g_key_file_has_group (key_file, groups[i]))
+        continue;
+
+      const SettingNamespaceInfo *ns_info = settings_registry_lookup_namespace (groups[i]);
+      if (ns_info == NULL)
+        {
+          g_debug ("Ignoring unknown settings namespace: %s", groups[i]);
+          continue;
+        }
+
+      for (size_t j = 0; j < ns_info->n_settings; j++)
+        {
+          const SettingInfo *info = &ns_info->settings[j];
+          SettingValue *old_value = settings_manager_get_key (settings_manager, info);
+          SettingChange change = { info, };
+
+          info->parse (info, key_file, &change.data);
+
+          if (old_value != NULL && info->equal (&old_value->value, &change.data))
+            {
+              setting_data_clear (info->value_type, &change.data);
+              continue;
+            }
+
+          g_array_append_val (changes, change);
+        }
+    }
+
+  return settings_manager_commit (settings_manager, changes, notify);
+}
 
 static void
-settings_manager__file_monitor__changed (GFileMonitor *monitor,
-                                         GFile *file,
-                                         GFile *other_file,
-                                         gpointer user_data)
+load_settings_config (GKeyFile *key_file,
+                      const char * const *changed_groups,
+                      bool notify,
+                      gpointer user_data)
 {
-  load_settings_config (user_data, true);
+  SettingsManager *settings_manager = user_data;
+
+  if (load_settings (settings_manager, key_file, changed_groups, notify))
+    settings_manager_rebuild_snapshot (settings_manager);
 }
 
-static void
-load_settings (SettingsManager *settings_manager,
-               GKeyFile *key_file,
-               bool notify)
+/* Checks that every namespace and key in @settings, of type a{sa{sv}}, is
+ * known and of the expected type */
+static bool
+settings_db_validate (GVariant *settings)
 {
-  gsize n_groups;
-  g_auto (GStrv) groups = g_key_file_get_groups (key_file, &n_groups);
+  GVariantIter ns_iter;
+  const char *ns_name;
+  GVariant *dict;
 
-  for (gsize i = 0; groups[i] != NULL; i++)
+  g_variant_iter_init (&ns_iter, settings);
+  while (g_variant_iter_next (&ns_iter, "{&s@a{sv}}", &ns_name, &dict))
     {
-      if (strcmp (groups[i], "org.freedesktop.appearance") == 0)
+      g_autoptr (GVariant) ns_dict = dict;
+      GVariantIter key_iter;
+      const char *key;
+      GVariant *value;
+
+      if (settings_registry_lookup_namespace (ns_name) == NULL)
+        return false;
+
+      g_variant_iter_init (&key_iter, ns_dict);
+      while (g_variant_iter_next (&key_iter, "{&sv}", &key, &value))
         {
-          SettingValue *new_value;
-
-          int color_scheme = g_key_file_get_integer (key_file, groups[i], "color-scheme", NULL);
-          new_value = setting_value_new_int ("org.freedesktop.appearance", "color-scheme", color_scheme);
-          if (settings_manager_set_key (settings_manager, new_value) && notify)
-            xdp_impl_settings_emit_setting_changed (XDP_IMPL_SETTINGS (settings_manager->helper),
-                                                    new_value->namespace,
-                                                    new_value->key,
-                                                    g_variant_new ("(v)", g_variant_new_int32 (new_value->value.v_int)));
-
-          int contrast = g_key_file_get_integer (key_file, groups[i], "contrast", NULL);
-          new_value = setting_value_new_int ("org.freedesktop.appearance", "contrast", contrast);
-          if (settings_manager_set_key (settings_manager, new_value) && notify)
-            xdp_impl_settings_emit_setting_changed (XDP_IMPL_SETTINGS (settings_manager->helper),
-                                                    new_value->namespace,
-                                                    new_value->key,
-                                                    g_variant_new ("(v)", g_variant_new_int32 (new_value->value.v_int)));
-
-          gsize n_items = 0;
-          double *accent_color = g_key_file_get_double_list (key_file, groups[i], "accent-color", &n_items, NULL);
-          new_value = setting_value_new_color ("org.freedesktop.appearance", "accent-color", n_items, accent_color);
-          if (settings_manager_set_key (settings_manager, new_value) && notify)
-            xdp_impl_settings_emit_setting_changed (XDP_IMPL_SETTINGS (settings_manager->helper),
-                                                    new_value->namespace,
-                                                    new_value->key,
-                                                    g_variant_new ("(v)",
-                                                                   g_variant_new ("(ddd)",
-                                                                                  new_value->value.v_color.red,
-                                                                                  new_value->value.v_color.green,
-                                                                                  new_value->value.v_color.blue)));
-          g_free (accent_color);
+          g_autoptr (GVariant) v = value;
+          const SettingInfo *info = settings_registry_lookup (ns_name, key);
+
+          if (info == NULL || !g_variant_is_of_type (v, G_VARIANT_TYPE (info->type_string)))
+            return false;
         }
     }
+
+  return true;
 }
 
+/* Loads the store from the settings section of the configuration image;
+ * the serialized values are views into the image, so they are neither
+ * copied nor boxed again */
 static bool
-load_settings_config (SettingsManager *settings_manager,
-                      bool notify)
-{
-  g_autoptr (GPtrArray) search_dirs = g_ptr_array_new_null_terminated (8, g_free, true);
-
-  /* XDG_CONFIG_HOME/SteamOS/portal/settings.conf */
-  GPathBuf buf;
-  g_path_buf_init_from_path (&buf, g_get_user_config_dir ());
-  g_path_buf_push (&buf, "SteamOS");
-  g_path_buf_push (&buf, "portal");
-  char *path = g_path_buf_clear_to_path (&buf);
-  g_ptr_array_add (search_dirs, path);
-
-  /* XDG_CONFIG_DIRS/SteamOS/portal/settings.conf */
-  const char * const *system_dirs = g_get_system_config_dirs ();
-  for (size_t i = 0; system_dirs[i] != NULL; i++)
+load_settings_db (SettingsManager *self,
+                  GVariant *db)
+{
+  g_autoptr (GVariant) settings = g_variant_get_child_value (db, CONFIG_DB_SETTINGS_INDEX);
+  g_autoptr (GArray) changes = g_array_new (FALSE, FALSE, sizeof (SettingChange));
+  GVariantIter ns_iter;
+  const char *ns_name;
+  GVariant *dict;
+
+  if (!settings_db_validate (settings))
+    return false;
+
+  g_array_set_clear_func (changes, setting_change_clear);
+
+  g_variant_iter_init (&ns_iter, settings);
+  while (g_variant_iter_next (&ns_iter, "{&s@a{sv}}", &ns_name, &dict))
     {
-      g_path_buf_init_from_path (&buf, system_dirs[i]);
-      g_path_buf_push (&buf, "SteamOS");
-      g_path_buf_push (&buf, "portal");
-      char *path = g_path_buf_clear_to_path (&buf);
+      g_autoptr (GVariant) ns_dict = dict;
+      GVariantIter key_iter;
+      const char *key;
+      GVariant *value;
+
+      g_variant_iter_init (&key_iter, ns_dict);
+      while (g_variant_iter_next (&key_iter, "{&sv}", &key, &value))
+        {
+          SettingChange change = {
+            .info = settings_registry_lookup (ns_name, key),
+            .serialized = value,
+          };
+
+          change.info->deserialize (value, &change.data);
+          g_array_append_val (changes, change);
+        }
+    }
+
+  settings_manager_apply_changes (self, changes);
+
+  bool has_empty = false;
+
+  g_variant_iter_init (&ns_iter, settings);
+  while (g_variant_iter_next (&ns_iter, "{&s@a{sv}}", &ns_name, &dict))
+    {
+      SettingNamespace *ns = &self->namespaces[settings_registry_lookup_namespace (ns_name)->index];
+
+      g_clear_pointer (&ns->serialized, g_variant_unref);
 
-      g_ptr_array_add (search_dirs, path);
+      /* Namespaces without any value are not listed, as in
+       * settings_manager_rebuild_snapshot() */
+      if (g_variant_n_children (dict) == 0)
+        {
+          g_variant_unref (dict);
+          has_empty = true;
+          continue;
+        }
+
+      ns->serialized = dict;
     }
 
-  g_autoptr (GKeyFile) kf = g_key_file_new ();
-  g_autofree char *full_path = NULL;
-  g_autoptr (GError) error = NULL;
+  g_clear_pointer (&self->snapshot, g_variant_unref);
 
-  if (!g_key_file_load_from_dirs (kf, "settings.conf", (const char **) search_dirs->pdata, &full_path, G_KEY_FILE_NONE, &error))
+  if (!has_empty)
     {
-      g_debug ("Unable to read settings.conf: %s", error->message);
-      return false;
+      self->snapshot = g_steal_pointer (&settings);
+      return true;
     }
 
-  g_debug ("Loading settings configuration from: %s", full_path);
+  GVariantBuilder builder;
 
-  load_settings (settings_manager, kf, notify);
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
 
-  if (settings_manager->file_monitor == NULL)
+  for (size_t i = 0; i < self->n_namespaces; i++)
     {
-      g_autoptr (GFile) file = g_file_new_for_path (full_path);
-      settings_manager->file_monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, &error);
-      if (error != NULL)
-        g_debug ("Unable to monitor settings.conf: %s", error->message);
+      SettingNamespace *ns = &self->namespaces[i];
 
-      g_signal_connect (settings_manager->file_monitor, "changed", G_CALLBACK (settings_manager__file_monitor__changed), settings_manager);
+      if (ns->serialized != NULL)
+        g_variant_builder_add (&builder, "{s@a{sv}}", ns->info->namespace, ns->serialized);
     }
 
+  self->snapshot = g_variant_ref_sink (g_variant_builder_end (&builder));
+
   return true;
 }
 
@@ -361,10 +604,28 @@ enum
   N_PROPS
 };
 
+/* The configuration is only loaded once the name is acquired, or by the
+ * first call needing it, so that it does not delay the portal's startup;
+ * no value can be read before that, so there is nothing to notify */
 static void
-settings_manager_constructed (GObject *gobject)
+settings_manager_ensure_loaded (SettingsManager *self)
 {
-  load_settings_config ((SettingsManager *) gobject, false);
+  if (self->loaded)
+    return;
+
+  self->loaded = true;
+
+  ConfigSourceFlags flags = CONFIG_SOURCE_FLAGS_NONE;
+  GVariant *db = config_db_get_default ();
+
+  if (db != NULL && load_settings_db (self, db))
+    flags |= CONFIG_SOURCE_FLAGS_NO_INITIAL_LOAD;
+
+  self->config_id = config_source_subscribe (config_source_get_default (),
+                                             "settings.conf",
+                                             flags,
+                                             load_settings_config,
+                                             self);
 }
 
 static void
@@ -372,8 +633,19 @@ settings_manager_finalize (GObject *gobject)
 {
   SettingsManager *self = SETTINGS_MANAGER (gobject);
 
-  g_clear_object (&self->file_monitor);
-  g_clear_pointer (&self->keys, g_hash_table_unref);
+  if (self->config_id != 0)
+    config_source_unsubscribe (config_source_get_default (), self->config_id);
+
+  for (size_t i = 0; i < settings_registry_get_n_settings (); i++)
+    g_clear_pointer (&self->values[i].serialized, g_variant_unref);
+  g_clear_pointer (&self->values, g_free);
+
+  for (size_t i = 0; i < self->n_namespaces; i++)
+    g_clear_pointer (&self->namespaces[i].serialized, g_variant_unref);
+  g_clear_pointer (&self->namespaces, g_free);
+
+  g_clear_pointer (&self->strings, g_string_chunk_free);
+  g_clear_pointer (&self->snapshot, g_variant_unref);
 
   G_OBJECT_CLASS (settings_manager_parent_class)->finalize (gobject);
 }
@@ -383,14 +655,25 @@ settings_manager_class_init (SettingsManagerClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 
-  gobject_class->constructed = settings_manager_constructed;
   gobject_class->finalize = settings_manager_finalize;
 }
 
 static void
 settings_manager_init (SettingsManager *self)
 {
-  self->keys = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, setting_namespace_free);
+  const SettingNamespaceInfo *ns_infos = settings_registry_get_namespaces ();
+
+  self->values = g_new0 (SettingValue, settings_registry_get_n_settings ());
+
+  self->n_namespaces = settings_registry_get_n_namespaces ();
+  self->namespaces = g_new0 (SettingNamespace, self->n_namespaces);
+  for (size_t i = 0; i < self->n_namespaces; i++)
+    {
+      self->namespaces[i].info = &ns_infos[i];
+      self->namespaces[i].values = &self->values[ns_infos[i].settings->index];
+    }
+
+  self->snapshot = g_variant_ref_sink (g_variant_new_array (G_VARIANT_TYPE ("{sa{sv}}"), NULL, 0));
 }
 
 static gboolean
@@ -404,39 +687,18 @@ settings_handle_read (XdpImplSettings *object,
 
   SettingsManager *self = data;
 
-  const SettingValue *v = settings_manager_get_key (self, arg_namespace, arg_key);
-  if (v == NULL)
-    goto out;
+  settings_manager_ensure_loaded (self);
 
-  if (strcmp (arg_namespace, "org.freedesktop.appearance") == 0)
-    {
-      if (strcmp (arg_key, "color-scheme") == 0)
-        {
-          g_dbus_method_invocation_return_value (invocation,
-                                                 g_variant_new ("(v)",
-                                                                g_variant_new_int32 (v->value.v_int)));
-          return TRUE;
-        }
+  const SettingInfo *info = settings_registry_lookup (arg_namespace, arg_key);
+  if (info == NULL)
+    goto out;
 
-      if (strcmp (arg_key, "contrast") == 0)
-        {
-          g_dbus_method_invocation_return_value (invocation,
-                                                 g_variant_new ("(v)",
-                                                                g_variant_new_int32 (v->value.v_int)));
-          return TRUE;
-        }
+  SettingValue *v = settings_manager_get_key (self, info);
+  if (v == NULL)
+    goto out;
 
-      if (strcmp (arg_key, "accent-color") == 0)
-        {
-          g_dbus_method_invocation_return_value (invocation,
-                                                 g_variant_new ("(v)",
-                                                                g_variant_new ("(ddd)",
-                                                                               v->value.v_color.red,
-                                                                               v->value.v_color.green,
-                                                                               v->value.v_color.blue)));
-          return TRUE;
-        }
-    }
+  g_dbus_method_invocation_return_value (invocation, g_variant_new ("(v)", v->serialized));
+  return TRUE;
 
 out:
   g_debug ("Attempted to read unknown namespace/key pair: %s %s", arg_namespace, arg_key);
@@ -456,34 +718,119 @@ settings_handle_read_all (XdpImplSettings *object,
 
   SettingsManager *self = data;
 
-  g_autoptr(GVariantBuilder) builder = g_variant_builder_new (G_VARIANT_TYPE ("(a{sa{sv}})"));
-  GHashTableIter ns_iter;
-  SettingNamespace *ns;
+  settings_manager_ensure_loaded (self);
+
+  g_autoptr(NamespaceFilter) filter = namespace_filter_compile (arg_namespaces);
 
-  g_variant_builder_open (builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+  /* Fast path: the whole snapshot was requested */
+  if (filter->match_all)
+    {
+      g_dbus_method_invocation_return_value (invocation, g_variant_new_tuple (&self->snapshot, 1));
+      return TRUE;
+    }
+
+  g_autofree bool *selected = g_new0 (bool, self->n_namespaces);
+  GVariantBuilder builder;
 
-  g_hash_table_iter_init (&ns_iter, self->keys);
-  while (g_hash_table_iter_next (&ns_iter, NULL, (gpointer *) &ns))
-    {   
-      GVariantDict dict;
+  settings_manager_select_namespaces (self, filter, selected);
 
-      if (!namespace_matches (ns->namespace, arg_namespaces))
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+
+  for (size_t i = 0; i < self->n_namespaces; i++)
+    {
+      SettingNamespace *ns = &self->namespaces[i];
+
+      if (!selected[i] || ns->serialized == NULL)
         continue;
 
-      g_variant_dict_init (&dict, NULL);
+      g_variant_builder_add (&builder, "{s@a{sv}}", ns->info->namespace, ns->serialized);
+    }
+
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(@a{sa{sv}})", g_variant_builder_end (&builder)));
+
+  return TRUE;
+}
+
+static gboolean
+settings_handle_write (HoloSettings *object,
+                       GDBusMethodInvocation *invocation,
+                       GVariant *arg_changes,
+                       GVariant *arg_options,
+                       gpointer data)
+{
+  g_debug ("Write");
+
+  SettingsManager *self = data;
+
+  settings_manager_ensure_loaded (self);
 
-      GHashTableIter key_iter;
-      SettingValue *value;
-      g_hash_table_iter_init (&key_iter, ns->keys);
-      while (g_hash_table_iter_next (&key_iter, NULL, (gpointer *) &value))
-        g_variant_dict_insert_value (&dict, value->key, setting_value_to_gvariant (value));
-  
-      g_variant_builder_add (builder, "{s@a{sv}}", ns->namespace, g_variant_dict_end (&dict));
-    }   
+  g_autoptr (GArray) changes = g_array_new (FALSE, FALSE, sizeof (SettingChange));
+  g_autoptr (GKeyFile) persisted = NULL;
+  gboolean persist = FALSE;
+  GVariantIter iter;
+  const char *namespace;
+  const char *key;
+  GVariant *value;
 
-  g_variant_builder_close (builder);
+  g_array_set_clear_func (changes, setting_change_clear);
 
-  g_dbus_method_invocation_return_value (invocation, g_variant_builder_end (builder));
+  g_variant_lookup (arg_options, "persist", "b", &persist);
+  if (persist)
+    persisted = g_key_file_new ();
+
+  /* Validate the whole batch before touching the store */
+  g_variant_iter_init (&iter, arg_changes);
+  while (g_variant_iter_next (&iter, "(&s&sv)", &namespace, &key, &value))
+    {
+      g_autoptr (GVariant) v = value;
+      const SettingInfo *info = settings_registry_lookup (namespace, key);
+
+      if (info == NULL)
+        {
+          g_dbus_method_invocation_return_error (invocation, XDG_DESKTOP_PORTAL_ERROR,
+                                                 XDG_DESKTOP_PORTAL_ERROR_NOT_FOUND,
+                                                 "Unknown setting: %s %s", namespace, key);
+          return TRUE;
+        }
+
+      if (!g_variant_is_of_type (v, G_VARIANT_TYPE (info->type_string)))
+        {
+          g_dbus_method_invocation_return_error (invocation, XDG_DESKTOP_PORTAL_ERROR,
+                                                 XDG_DESKTOP_PORTAL_ERROR_INVALID_ARGUMENT,
+                                                 "Invalid type for %s %s: expected %s, got %s",
+                                                 namespace, key, info->type_string,
+                                                 g_variant_get_type_string (v));
+          return TRUE;
+        }
+
+      SettingValue *old_value = settings_manager_get_key (self, info);
+      SettingChange change = { info, };
+
+      info->deserialize (v, &change.data);
+
+      if (persisted != NULL)
+        info->save (info, persisted, &change.data);
+
+      if (old_value != NULL && info->equal (&old_value->value, &change.data))
+        {
+          setting_data_clear (info->value_type, &change.data);
+          continue;
+        }
+
+      change.serialized = g_steal_pointer (&v);
+      g_array_append_val (changes, change);
+    }
+
+  if (settings_manager_commit (self, changes, true))
+    settings_manager_rebuild_snapshot (self);
+
+  /* The reload that follows finds the values already in the store, so it
+   * does not emit SettingChanged again */
+  if (persisted != NULL)
+    config_source_save (config_source_get_default (), "settings.conf", persisted);
+
+  holo_settings_complete_write (object, invocation);
 
   return TRUE;
 }
@@ -511,8 +858,31 @@ settings_init (GDBusConnection *connection,
 
       g_debug ("Providing implementation for interface: %s", g_dbus_interface_skeleton_get_info (helper)->name);
 
+      GDBusInterfaceSkeleton *private_helper =
+        G_DBUS_INTERFACE_SKELETON (holo_settings_skeleton_new ());
+
+      res->private_helper = private_helper;
+
+      g_signal_connect (private_helper, "handle-write", G_CALLBACK (settings_handle_write), res);
+
+      if (!g_dbus_interface_skeleton_export (private_helper, connection, DESKTOP_PORTAL_OBJECT_PATH, error))
+        {
+          g_dbus_interface_skeleton_unexport (helper);
+          g_object_unref (res);
+          return false;
+        }
+
+      g_debug ("Providing implementation for interface: %s", g_dbus_interface_skeleton_get_info (private_helper)->name);
+
       g_once_init_leave_pointer (&manager, res);
     }
 
   return true;
 }
+
+void
+settings_load (void)
+{
+  if (manager != NULL)
+    settings_manager_ensure_loaded (manager);
+}
@@ -12,4 +12,7 @@ bool
 settings_init (GDBusConnection *connection,
                GError **error);
 
+void
+settings_load (void);
+
 G_END_DECLS
@@ -0,0 +1,99 @@
+// uri-helper.c: Applications opening URIs on behalf of the portal
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "config.h"
+
+#include "uri-helper.h"
+
+#include "utils.h"
+
+#include <gio/gdesktopappinfo.h>
+#include <stdbool.h>
+
+/* Resolved on first use, and dropped whenever the installed applications
+ * change */
+static UriHelper *steam_uri_helper;
+static bool steam_uri_helper_resolved;
+static GAppInfoMonitor *app_info_monitor;
+
+static void
+uri_helper_clear (gpointer data)
+{
+  UriHelper *helper = data;
+
+  g_clear_object (&helper->info);
+  g_clear_pointer (&helper->app_id, g_free);
+  g_clear_pointer (&helper->choose_results, g_variant_unref);
+  g_clear_pointer (&helper->command, launch_command_free);
+}
+
+UriHelper *
+uri_helper_new (GAppInfo *info)
+{
+  UriHelper *helper = g_rc_box_new0 (UriHelper);
+
+  helper->info = info;
+  helper->app_id = xdp_get_app_id_from_desktop_id (g_app_info_get_id (info));
+
+  GVariantBuilder opt_builder;
+  g_variant_builder_init (&opt_builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&opt_builder, "{sv}", "choice", g_variant_new_string (helper->app_id));
+  helper->choose_results = g_variant_ref_sink (g_variant_builder_end (&opt_builder));
+
+  helper->command = launch_command_new (info);
+
+  return helper;
+}
+
+UriHelper *
+uri_helper_ref (UriHelper *helper)
+{
+  return g_rc_box_acquire (helper);
+}
+
+void
+uri_helper_unref (UriHelper *helper)
+{
+  g_rc_box_release_full (helper, uri_helper_clear);
+}
+
+static void
+app_info_monitor__changed (GAppInfoMonitor *monitor,
+                           gpointer user_data)
+{
+  g_debug ("Installed applications changed, dropping the Steam helper");
+
+  g_clear_pointer (&steam_uri_helper, uri_helper_unref);
+  steam_uri_helper_resolved = false;
+}
+
+UriHelper *
+get_steam_uri_helper (void)
+{
+  if (!steam_uri_helper_resolved)
+    {
+      if (app_info_monitor == NULL)
+        {
+          app_info_monitor = g_app_info_monitor_get ();
+          g_signal_connect (app_info_monitor, "changed", G_CALLBACK (app_info_monitor__changed), NULL);
+        }
+
+      steam_uri_helper_resolved = true;
+
+      GAppInfo *info = G_APP_INFO (g_desktop_app_info_new (I_("steam_http_loader.desktop")));
+      if (info == NULL)
+        {
+          g_warning ("Unable to locate Steam helper to open files");
+          return NULL;
+        }
+
+      steam_uri_helper = uri_helper_new (info);
+    }
+
+  if (steam_uri_helper == NULL)
+    return NULL;
+
+  return uri_helper_ref (steam_uri_helper);
+}
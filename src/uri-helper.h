@@ -0,0 +1,40 @@
+// uri-helper.h: Applications opening URIs on behalf of the portal
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "launcher.h"
+
+G_BEGIN_DECLS
+
+typedef struct
+{
+  GAppInfo *info;
+
+  /* Application ID, derived from the desktop file ID */
+  char *app_id;
+
+  /* Results of a ChooseApplication call picking the helper; type: a{sv} */
+  GVariant *choose_results;
+
+  /* NULL if the helper can only be launched through @info */
+  LaunchCommand *command;
+} UriHelper;
+
+/* Returns a reference to the Steam helper, resolved once and cached until
+ * the installed applications change, or NULL if it is not installed */
+UriHelper *get_steam_uri_helper (void);
+
+/* Takes ownership of @info */
+UriHelper *uri_helper_new (GAppInfo *info);
+
+UriHelper *uri_helper_ref (UriHelper *helper);
+void uri_helper_unref (UriHelper *helper);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (UriHelper, uri_helper_unref)
+
+G_END_DECLS
@@ -0,0 +1,273 @@
+// uri-router.c: Routing of URIs to the helpers that open them
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "config.h"
+
+#include "uri-router.h"
+
+#include "config-source.h"
+
+#include <gio/gdesktopappinfo.h>
+#include <string.h>
+
+#define ROUTING_CONF "routing.conf"
+#define ROUTES_GROUP "Routes"
+
+#define NO_NODE G_MAXUINT32
+#define NO_ROUTE G_MAXUINT32
+
+/* A node of the trie of route keys; children are linked through their
+ * siblings, since most nodes only have one */
+typedef struct
+{
+  guint32 first_child;
+  guint32 next_sibling;
+
+  /* Index in UriRouter.routes of the route ending here, or NO_ROUTE */
+  guint32 route;
+
+  char c;
+} RouteNode;
+
+struct _UriRouter
+{
+  /* Array<RouteNode>, the root first */
+  GArray *nodes;
+
+  /* Array<UriHelper> */
+  GPtrArray *routes;
+
+  /* The last routing configuration, to resolve the routes again when the
+   * installed applications change */
+  GKeyFile *key_file;
+  GAppInfoMonitor *app_info_monitor;
+
+  guint config_id;
+};
+
+static UriRouter *default_router;
+
+static guint32
+route_node_find_child (GArray *nodes,
+                       guint32 parent,
+                       char c)
+{
+  guint32 child = g_array_index (nodes, RouteNode, parent).first_child;
+
+  while (child != NO_NODE && g_array_index (nodes, RouteNode, child).c != c)
+    child = g_array_index (nodes, RouteNode, child).next_sibling;
+
+  return child;
+}
+
+static void
+route_trie_insert (GArray *nodes,
+                   const char *key,
+                   guint32 route)
+{
+  guint32 node = 0;
+
+  for (const char *p = key; *p != '\0'; p++)
+    {
+      guint32 child = route_node_find_child (nodes, node, *p);
+
+      if (child == NO_NODE)
+        {
+          RouteNode new_node = {
+            .first_child = NO_NODE,
+            .next_sibling = g_array_index (nodes, RouteNode, node).first_child,
+            .route = NO_ROUTE,
+            .c = *p,
+          };
+
+          g_array_append_val (nodes, new_node);
+          child = nodes->len - 1;
+          g_array_index (nodes, RouteNode, node).first_child = child;
+        }
+
+      node = child;
+    }
+
+  g_array_index (nodes, RouteNode, node).route = route;
+}
+
+/* Keys are either a scheme, matching all of its URIs, or a URI prefix;
+ * schemes are case-insensitive, so they are stored in lower case */
+static char *
+route_key_normalize (const char *key)
+{
+  const char *colon = strchr (key, ':');
+  size_t scheme_len = colon != NULL ? (size_t) (colon - key) : strlen (key);
+
+  if (scheme_len == 0 || !g_ascii_isalpha (key[0]))
+    return NULL;
+
+  for (size_t i = 1; i < scheme_len; i++)
+    {
+      if (!g_ascii_isalnum (key[i]) && key[i] != '+' && key[i] != '-' && key[i] != '.')
+        return NULL;
+    }
+
+  g_autofree char *scheme = g_ascii_strdown (key, scheme_len);
+
+  return g_strconcat (scheme, ":", colon != NULL ? colon + 1 : "", NULL);
+}
+
+static UriHelper *
+resolve_route_target (const char *target)
+{
+  g_autofree char *desktop_id = g_str_has_suffix (target, ".desktop") ?
+                                g_strdup (target) :
+                                g_strconcat (target, ".desktop", NULL);
+  GDesktopAppInfo *info = g_desktop_app_info_new (desktop_id);
+
+  if (info == NULL)
+    return NULL;
+
+  return uri_helper_new (G_APP_INFO (info));
+}
+
+static void
+uri_router_rebuild (UriRouter *self)
+{
+  GKeyFile *kf = self->key_file;
+  g_autoptr (GArray) nodes = g_array_new (FALSE, FALSE, sizeof (RouteNode));
+  g_autoptr (GPtrArray) routes = g_ptr_array_new_with_free_func ((GDestroyNotify) uri_helper_unref);
+  RouteNode root = { .first_child = NO_NODE, .next_sibling = NO_NODE, .route = NO_ROUTE };
+
+  g_array_append_val (nodes, root);
+
+  g_auto (GStrv) keys = g_key_file_get_keys (kf, ROUTES_GROUP, NULL, NULL);
+  for (size_t i = 0; keys != NULL && keys[i] != NULL; i++)
+    {
+      g_autofree char *key = route_key_normalize (keys[i]);
+      g_autofree char *target = g_key_file_get_string (kf, ROUTES_GROUP, keys[i], NULL);
+
+      if (key == NULL || target == NULL)
+        {
+          g_warning ("Ignoring invalid route %s", keys[i]);
+          continue;
+        }
+
+      /* Resolving the helpers now keeps the desktop file lookups out of
+       * the method calls */
+      UriHelper *helper = resolve_route_target (target);
+      if (helper == NULL)
+        {
+          g_warning ("Unable to locate %s to route %s to", target, keys[i]);
+          continue;
+        }
+
+      g_debug ("Routing %s to %s", key, helper->app_id);
+
+      route_trie_insert (nodes, key, routes->len);
+      g_ptr_array_add (routes, helper);
+    }
+
+  g_clear_pointer (&self->nodes, g_array_unref);
+  g_clear_pointer (&self->routes, g_ptr_array_unref);
+  self->nodes = g_steal_pointer (&nodes);
+  self->routes = g_steal_pointer (&routes);
+}
+
+static void
+load_routing_config (GKeyFile *kf,
+                     const char * const *changed_groups,
+                     bool notify,
+                     gpointer user_data)
+{
+  UriRouter *self = user_data;
+
+  g_clear_pointer (&self->key_file, g_key_file_unref);
+  self->key_file = g_key_file_ref (kf);
+
+  if (notify && !g_strv_contains (changed_groups, ROUTES_GROUP))
+    return;
+
+  uri_router_rebuild (self);
+}
+
+/* Helpers may have been installed, removed or updated, so the same way as
+ * the Steam helper, the routes are resolved again */
+static void
+app_info_monitor__changed (GAppInfoMonitor *monitor,
+                           gpointer user_data)
+{
+  UriRouter *self = user_data;
+
+  if (self->key_file == NULL)
+    return;
+
+  g_debug ("Installed applications changed, resolving the routes again");
+
+  uri_router_rebuild (self);
+}
+
+static UriRouter *
+uri_router_new (void)
+{
+  UriRouter *self = g_new0 (UriRouter, 1);
+
+  self->app_info_monitor = g_app_info_monitor_get ();
+  g_signal_connect (self->app_info_monitor, "changed", G_CALLBACK (app_info_monitor__changed), self);
+
+  self->config_id = config_source_subscribe (config_source_get_default (),
+                                             ROUTING_CONF,
+                                             CONFIG_SOURCE_FLAGS_NONE,
+                                             load_routing_config,
+                                             self);
+
+  return self;
+}
+
+UriRouter *
+uri_router_get_default (void)
+{
+  if (g_once_init_enter_pointer (&default_router))
+    g_once_init_leave_pointer (&default_router, uri_router_new ());
+
+  return default_router;
+}
+
+UriHelper *
+uri_router_lookup (UriRouter *self,
+                   const char *uri)
+{
+  guint32 best = NO_ROUTE;
+  guint32 node = 0;
+  bool in_scheme = true;
+
+  if (self->nodes == NULL)
+    return NULL;
+
+  for (const char *p = uri; *p != '\0'; p++)
+    {
+      char c = in_scheme ? g_ascii_tolower (*p) : *p;
+
+      if (*p == ':')
+        in_scheme = false;
+
+      node = route_node_find_child (self->nodes, node, c);
+      if (node == NO_NODE)
+        break;
+
+      if (g_array_index (self->nodes, RouteNode, node).route != NO_ROUTE)
+        best = g_array_index (self->nodes, RouteNode, node).route;
+    }
+
+  if (best == NO_ROUTE)
+    return NULL;
+
+  return uri_helper_ref (g_ptr_array_index (self->routes, best));
+}
+
+UriHelper *
+uri_router_lookup_scheme (UriRouter *self,
+                          const char *scheme)
+{
+  g_autofree char *uri = g_strconcat (scheme, ":", NULL);
+
+  return uri_router_lookup (self, uri);
+}
@@ -0,0 +1,32 @@
+// uri-router.h: Routing of URIs to the helpers that open them
+//
+// SPDX-FileCopyrightText: 2025 Valve Corporation
+// SPDX-License-Identifier: BSD-3-Clause
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "uri-helper.h"
+
+G_BEGIN_DECLS
+
+typedef struct _UriRouter UriRouter;
+
+/* Returns the router, which follows routing.conf */
+UriRouter *
+uri_router_get_default (void);
+
+/* Returns a reference to the helper of the route matching the longest
+ * prefix of @uri, or NULL if there is none */
+UriHelper *
+uri_router_lookup (UriRouter *self,
+                   const char *uri);
+
+/* Returns a reference to the helper of the route for every URI using
+ * @scheme, or NULL if there is none */
+UriHelper *
+uri_router_lookup_scheme (UriRouter *self,
+                          const char *scheme);
+
+G_END_DECLS
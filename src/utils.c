@@ -12,7 +12,6 @@
 #include <unistd.h>
 
 #include <gio/gio.h>
-#include <gio/gdesktopappinfo.h>
 
 typedef enum {
   MESSAGE_TYPE_INFO,
@@ -114,14 +113,6 @@ xdg_desktop_portal_error_quark (void)
   return (GQuark) quark_volatile;
 }
 
-GAppInfo *get_steam_uri_helper ()
-{
-  GAppInfo *info = G_APP_INFO (g_desktop_app_info_new (I_("steam_http_loader.desktop")));
-  if (!info)
-    g_warning ("Unable to locate Steam helper to open files");
-  return info;
-}
-
 // Copied from xdg-desktop-portal
 // (https://github.com/flatpak/xdg-desktop-portal/blob/522236e/src/xdp-utils.c#L346-L354)
 char *
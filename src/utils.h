@@ -41,8 +41,6 @@ void
 print_info (const char *fmt,
             ...);
 
-GAppInfo *get_steam_uri_helper (void);
-
 char *xdp_get_app_id_from_desktop_id (const char *desktop_id);
 
 G_END_DECLS
@@ -6,8 +6,10 @@
 #include "config.h"
 
 #include "appchooser.h"
+#include "config-source.h"
 #include "email.h"
 #include "lockdown.h"
+#include "rate-limit.h"
 #include "settings.h"
 
 #include "utils.h"
@@ -21,6 +23,7 @@
 static gboolean opt_verbose;
 static gboolean opt_replace;
 static gboolean opt_version;
+static int opt_reload_delay = -1;
 
 static GOptionEntry opt_entries[] = {
   {
@@ -41,6 +44,15 @@ static GOptionEntry opt_entries[] = {
     .description = "Replace a running instance",
     .arg_description = NULL,
   },
+  {
+    .long_name = "reload-delay",
+    .short_name = 0,
+    .flags = 0,
+    .arg = G_OPTION_ARG_INT,
+    .arg_data = &opt_reload_delay,
+    .description = "Delay before reloading a modified configuration file",
+    .arg_description = "MSEC",
+  },
   {
     .long_name = "version",
     .short_name = 0,
@@ -91,6 +103,12 @@ on_bus_acquired (GDBusConnection *bus,
       print_warning ("Unable to initialize settings interface: %s", error->message);
       g_clear_error (&error);
     }
+
+  if (!rate_limit_init (bus, &error))
+    {
+      print_warning ("Unable to initialize rate limit interface: %s", error->message);
+      g_clear_error (&error);
+    }
 }
 
 static void
@@ -99,6 +117,11 @@ on_name_acquired (GDBusConnection *bus,
                   gpointer user_data G_GNUC_UNUSED)
 {
   print_info ("Name acquired: %s", name);
+
+  /* Reading the configuration is left until now, so that it does not delay
+   * the name, which xdg-desktop-portal is waiting for */
+  lockdown_load ();
+  settings_load ();
 }
 
 static void
@@ -140,6 +163,9 @@ main (int argc,
       return EXIT_SUCCESS;
     }
 
+  if (opt_reload_delay >= 0)
+    config_source_set_reload_delay (opt_reload_delay);
+
   GDBusConnection *session_bus = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
   if (session_bus == NULL && error != NULL)
     {